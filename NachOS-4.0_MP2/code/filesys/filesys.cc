@@ -126,7 +126,7 @@ FileSystem::FileSystem(bool format)
 	freeMap->WriteBack(freeMapFile);	 // flush changes to disk
 	directory->WriteBack(directoryFile);
 
-	if (debug->IsEnabled('f')) {
+	if (DebugIsOn('f')) {
 	    freeMap->Print();
 	    directory->Print();
         }
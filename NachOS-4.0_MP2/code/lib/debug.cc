@@ -1,6 +1,7 @@
 // debug.cc 
 //	Debugging routines.  Allows users to control whether to 
-//	print DEBUG statements, based on a command line argument.
+//	print DEBUG statements, based on a command line argument,
+//	and to record TRACE events in binary rather than print them.
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -10,6 +11,67 @@
 #include "utility.h"
 #include "debug.h" 
 #include "string.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+// How each TraceEvent is printed.  These are the messages the DEBUG
+// statements they replaced printed.
+
+static const char *traceFormats[NumTraceEvents] = {
+    "Reading VA %d, size %d",
+    "\tvalue read = %d",
+    "Writing VA %d, size %d, value %d",
+    "\tTranslate %d , read",
+    "\tTranslate %d , write",
+    "phys addr = %d",
+    "TLB entry %d loaded with virtual page %d",
+    "== Tick %d ==",
+    "In Machine::Run(), into OneInstruction == Tick %d ==",
+    "In Machine::Run(), return from OneInstruction  == Tick %d ==",
+    "In Machine::Run(), into OneTick == Tick %d ==",
+    "In Machine::Run(), return from OneTick == Tick %d ==",
+    "In Machine::OneInstruction, RaiseException(SyscallException, 0), %d",
+    "In Interrupt::Idle, into CheckIfDue, %d",
+    "In Interrupt::Idle, return true from CheckIfDue, %d",
+    "In Interrupt::Idle, return false from CheckIfDue, %d",
+    "In Interrupt::CheckIfDue, into callOnInterrupt->CallBack, %d",
+    "In Interrupt::CheckIfDue, return from callOnInterrupt->CallBack, %d",
+    "Lock: thread %d, priority %d, waits for thread %d",
+    "Lock: thread %d, priority %d, holds the lock, after waiting %d ticks",
+    "Lock: thread %d releases the lock, held %d ticks, now priority %d",
+    "Lock: thread %d lends priority %d to thread %d",
+    "Switch: thread %d blocks, thread %d runs, after waiting %d ticks",
+    "Switch: thread %d finishes, thread %d runs, after waiting %d ticks",
+    "Switch: thread %d yields, thread %d runs, after waiting %d ticks",
+    "Switch: thread %d's time slice is up, thread %d runs, after waiting %d ticks",
+    "Switch: thread %d is preempted, thread %d runs, after waiting %d ticks",
+};
+
+// What a saved trace starts with.
+
+class TraceHeader {
+  public:
+    int magic;			// TraceMagic
+    int numRecords;		// events that follow, oldest first
+};
+
+const int TraceMagic = 0x74726333;	// changes with the event list
+
+//----------------------------------------------------------------------
+// PrintEvent
+// 	Print an event the way the DEBUG statement it stands for would.
+//----------------------------------------------------------------------
+
+static void
+PrintEvent(TraceRecord *record)
+{
+    char line[200];
+
+    ASSERT(record->event < NumTraceEvents);
+    snprintf(line, sizeof(line), traceFormats[record->event],
+		record->args[0], record->args[1], record->args[2]);
+    cerr << line << "\n";
+}
 
 //----------------------------------------------------------------------
 // Debug::Debug
@@ -24,22 +86,139 @@
 
 Debug::Debug(char *flagList)
 {
-    enableFlags = flagList;
+    bool all = (flagList != NULL && strchr(flagList, dbgAll) != NULL);
+
+    for (int i = 0; i < 256; i++)
+	enabled[i] = all || (flagList != NULL && i != 0 
+				&& strchr(flagList, i) != NULL);
+    clock = NULL;
+    ring = NULL;
+    next = 0;
+    traceFile = NULL;
 }
 
+//----------------------------------------------------------------------
+// Debug::~Debug
+//      De-allocate the recorded events, if any.
+//----------------------------------------------------------------------
+
+Debug::~Debug()
+{
+    delete [] ring;
+}
 
 //----------------------------------------------------------------------
-// Debug::IsEnabled
-//      Return TRUE if DEBUG messages with "flag" are to be printed.
+// Debug::RecordTo
+//      From now on, keep the latest TRACE events in a ring buffer
+//	instead of printing them, and when Nachos exits, save them in
+//	"fileName".
+//----------------------------------------------------------------------
+
+void
+Debug::RecordTo(char *fileName)
+{
+    ASSERT((TraceRingSize & (TraceRingSize - 1)) == 0);
+    traceFile = fileName;
+    if (ring == NULL)
+	ring = new TraceRecord[TraceRingSize];
+    next = 0;
+}
+
+//----------------------------------------------------------------------
+// Debug::Record
+//      A TRACE event with an enabled flag has happened.  Print it, or
+//	if we are recording, store it over the oldest one in the ring.
+//	Nachos only ever runs one thread at a time, so there is just
+//	one writer, and no locking is needed.
+//----------------------------------------------------------------------
+
+void
+Debug::Record(char flag, TraceEvent event, int a0, int a1, int a2)
+{
+    TraceRecord record;
+    TraceRecord *r = (ring != NULL) ? &ring[next++ & (TraceRingSize - 1)]
+				: &record;
+
+    r->tick = (clock != NULL) ? *clock : 0;
+    r->flag = flag;
+    r->event = event;
+    r->args[0] = a0;
+    r->args[1] = a1;
+    r->args[2] = a2;
+    if (ring == NULL)
+	PrintEvent(r);
+}
+
+//----------------------------------------------------------------------
+// Debug::SaveTrace
+//      Write the events recorded, oldest first, to the trace file.
+//	Only the latest TraceRingSize of them are still there.
+//
+//	This is called from ASSERT, so it must not assert itself: the
+//	trace file is forgotten before any I/O, and errors are just
+//	printed.
+//----------------------------------------------------------------------
+
+void
+Debug::SaveTrace()
+{
+    TraceHeader header;
+    unsigned int first;
+    char *fileName = traceFile;
+    int fd;
+    bool ok;
+
+    if (ring == NULL || fileName == NULL)
+	return;
+    traceFile = NULL;			// only once
+    first = (next > (unsigned) TraceRingSize) ? next - TraceRingSize : 0;
+    header.magic = TraceMagic;
+    header.numRecords = next - first;
+    fd = open(fileName, O_RDWR|O_CREAT|O_TRUNC, 0666);
+    if (fd < 0) {
+	cerr << "Can't open trace file " << fileName << "\n";
+	return;
+    }
+    ok = (write(fd, (char *) &header, sizeof(header)) == sizeof(header));
+    for (unsigned int i = first; ok && i != next; i++)
+	ok = (write(fd, (char *) &ring[i & (TraceRingSize - 1)],
+			sizeof(TraceRecord)) == sizeof(TraceRecord));
+    if (!ok)
+	cerr << "Can't write trace file " << fileName << "\n";
+    close(fd);
+}
+
+//----------------------------------------------------------------------
+// Debug::PrintTrace
+//      Print the events saved in trace file "fileName", as they would
+//	have been printed at the time.
+//
+//	Returns FALSE if the file isn't a trace, or is cut short.
 //----------------------------------------------------------------------
 
 bool
-Debug::IsEnabled(char flag)
+Debug::PrintTrace(char *fileName)
 {
-    if (enableFlags != NULL) {
-	return ((strchr(enableFlags, flag) != 0) 
-		|| (strchr(enableFlags, '+') != 0));
-    } else {
-    	return FALSE;
+    TraceHeader header;
+    TraceRecord record;
+    int fd = OpenForReadWrite(fileName, TRUE);
+
+    if (ReadPartial(fd, (char *) &header, sizeof(header)) != sizeof(header)
+		|| header.magic != TraceMagic) {
+	cerr << fileName << " is not a Nachos trace\n";
+	Close(fd);
+	return FALSE;
+    }
+    for (int i = 0; i < header.numRecords; i++) {
+	if (ReadPartial(fd, (char *) &record, sizeof(record))
+						!= sizeof(record)) {
+	    cerr << fileName << " is truncated after " << i << " of "
+			<< header.numRecords << " records\n";
+	    Close(fd);
+	    return FALSE;
+	}
+	PrintEvent(&record);
     }
+    Close(fd);
+    return TRUE;
 }
@@ -6,6 +6,19 @@
 //	passed to Nachos (-d).  You are encouraged to add your own
 //	debugging flags.  Please.... 
 //
+//	Which flags can be turned on at all is fixed when Nachos is
+//	compiled: define DEBUG_ONLY, and DEBUG_<FLAG> for each flag to
+//	keep (e.g. -DDEBUG_ONLY -DDEBUG_ADDR -DDEBUG_SYS), and the
+//	messages for every other flag are compiled out, along with the
+//	test for whether they are on.  By default they are all kept.
+//
+//	The messages printed for every instruction or every tick are
+//	TRACE events instead, with a fixed format and up to three int
+//	arguments.  These are printed just like DEBUG messages, unless
+//	they are being recorded (-dr): then they are stored compactly
+//	in a ring buffer, which is written to a file when Nachos exits,
+//	and can be turned back into the usual text later (-dp).
+//
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -33,14 +46,163 @@ const char dbgTraCode = 'c';
 
 const char dbgSch = 'z';
 
+// The flags whose messages are compiled in.  Each is 1 or 0, worked
+// out by the preprocessor, so that a disabled DEBUG or TRACE is a
+// constant test, which the compiler drops even without -O.
+
+#if !defined(DEBUG_ONLY) || defined(DEBUG_THREAD)
+#define DEBUG_COMPILED_THREAD 1
+#else
+#define DEBUG_COMPILED_THREAD 0
+#endif
+#if !defined(DEBUG_ONLY) || defined(DEBUG_SYNCH)
+#define DEBUG_COMPILED_SYNCH 1
+#else
+#define DEBUG_COMPILED_SYNCH 0
+#endif
+#if !defined(DEBUG_ONLY) || defined(DEBUG_INT)
+#define DEBUG_COMPILED_INT 1
+#else
+#define DEBUG_COMPILED_INT 0
+#endif
+#if !defined(DEBUG_ONLY) || defined(DEBUG_MACH)
+#define DEBUG_COMPILED_MACH 1
+#else
+#define DEBUG_COMPILED_MACH 0
+#endif
+#if !defined(DEBUG_ONLY) || defined(DEBUG_DISK)
+#define DEBUG_COMPILED_DISK 1
+#else
+#define DEBUG_COMPILED_DISK 0
+#endif
+#if !defined(DEBUG_ONLY) || defined(DEBUG_FILE)
+#define DEBUG_COMPILED_FILE 1
+#else
+#define DEBUG_COMPILED_FILE 0
+#endif
+#if !defined(DEBUG_ONLY) || defined(DEBUG_ADDR)
+#define DEBUG_COMPILED_ADDR 1
+#else
+#define DEBUG_COMPILED_ADDR 0
+#endif
+#if !defined(DEBUG_ONLY) || defined(DEBUG_NET)
+#define DEBUG_COMPILED_NET 1
+#else
+#define DEBUG_COMPILED_NET 0
+#endif
+#if !defined(DEBUG_ONLY) || defined(DEBUG_SYS)
+#define DEBUG_COMPILED_SYS 1
+#else
+#define DEBUG_COMPILED_SYS 0
+#endif
+#if !defined(DEBUG_ONLY) || defined(DEBUG_TRACODE)
+#define DEBUG_COMPILED_TRACODE 1
+#else
+#define DEBUG_COMPILED_TRACODE 0
+#endif
+#if !defined(DEBUG_ONLY) || defined(DEBUG_SCH)
+#define DEBUG_COMPILED_SCH 1
+#else
+#define DEBUG_COMPILED_SCH 0
+#endif
+
+// Is "flag" compiled in?  "flag" must be one of the constants above.
+#define DebugCompiled(flag) \
+    ((flag) == dbgThread ? DEBUG_COMPILED_THREAD : \
+    ((flag) == dbgSynch ? DEBUG_COMPILED_SYNCH : \
+    ((flag) == dbgInt ? DEBUG_COMPILED_INT : \
+    ((flag) == dbgMach ? DEBUG_COMPILED_MACH : \
+    ((flag) == dbgDisk ? DEBUG_COMPILED_DISK : \
+    ((flag) == dbgFile ? DEBUG_COMPILED_FILE : \
+    ((flag) == dbgAddr ? DEBUG_COMPILED_ADDR : \
+    ((flag) == dbgNet ? DEBUG_COMPILED_NET : \
+    ((flag) == dbgSys ? DEBUG_COMPILED_SYS : \
+    ((flag) == dbgTraCode ? DEBUG_COMPILED_TRACODE : \
+    ((flag) == dbgSch ? DEBUG_COMPILED_SCH : \
+    1)))))))))))
+
+// Is "flag" on?  Checks that it is compiled in first, outside of any
+// function call, so the check costs nothing when it isn't.
+#define DebugIsOn(flag) \
+    (DebugCompiled(flag) && ::debug->IsEnabled(flag))
+
+// The events that can be recorded in binary.  Each has a printf
+// format, in debug.cc, with a %d for each of its arguments.
+
+enum TraceEvent {
+    TraceReadMem,		// dbgAddr: ReadMem, before translation
+    TraceValueRead,		//	... and the value it read
+    TraceWriteMem,		// dbgAddr: WriteMem, before translation
+    TraceTranslateRead,		// dbgAddr: Translate, for a read
+    TraceTranslateWrite,	//	... for a write
+    TracePhysAddr,		//	... the physical address found
+    TraceTLBLoad,		// dbgAddr: RefillTLB
+    TraceTick,			// dbgInt: OneTick
+    TraceRunInstrIn,		// dbgTraCode: Machine::Run
+    TraceRunInstrOut,
+    TraceRunTickIn,
+    TraceRunTickOut,
+    TraceSyscall,		// dbgTraCode: a syscall instruction
+    TraceIdleIn,		// dbgTraCode: Interrupt::Idle
+    TraceIdleTrue,
+    TraceIdleFalse,
+    TraceCallBackIn,		// dbgTraCode: Interrupt::CheckIfDue
+    TraceCallBackOut,
+    TraceLockWait,		// dbgSynch: Lock::Acquire, having to wait
+    TraceLockHold,		//	... and once it has the lock
+    TraceLockRelease,		// dbgSynch: Lock::Release
+    TraceLockLend,		// dbgSynch: a lock holder inherits a
+				// waiter's priority
+    TraceSwitchBlock,		// dbgThread: Scheduler::Run, the old
+				// thread having blocked
+    TraceSwitchFinish,		//	... finished
+    TraceSwitchYield,		//	... yielded
+    TraceSwitchSlice,		//	... had its time slice run out
+    TraceSwitchPreempt,		//	... been preempted
+    NumTraceEvents
+};
+
+// One recorded event.
+
+class TraceRecord {
+  public:
+    int tick;			// when it happened
+    char flag;			// its debug flag
+    unsigned char event;	// which TraceEvent it is
+    int args[3];		// its arguments
+};
+
+const int TraceRingSize = 1 << 16;	// events kept when recording;
+					// must be a power of two
+
 class Debug {
   public:
     Debug(char *flagList);
+    ~Debug();
+
+    bool IsEnabled(char flag) { return enabled[(unsigned char) flag]; }
+				// Is "flag" on?  Use DebugIsOn, to
+				// skip flags that are compiled out
 
-    bool IsEnabled(char flag);
+    void SetClock(int *ticks) { clock = ticks; }
+				// Where to read the time for TRACE events
+    void RecordTo(char *fileName);
+				// Record TRACE events, instead of printing
+				// them, to be saved in "fileName"
+    void Record(char flag, TraceEvent event, int a0, int a1 = 0, int a2 = 0);
+				// Print or record an event
+    void SaveTrace();		// Write out the events recorded
+    static bool PrintTrace(char *fileName);
+				// Print the events saved in "fileName"
 
   private:
-    char *enableFlags;		// controls which DEBUG messages are printed
+    bool enabled[256];		// which DEBUG messages are printed
+    int *clock;			// the simulated time; NULL before there is one
+
+    TraceRecord *ring;		// recorded events; NULL if printing them
+    unsigned int next;		// count of events recorded so far; the
+				// next one goes in ring[next % TraceRingSize]
+    char *traceFile;		// where to save them
 };
 
 extern Debug *debug;
@@ -51,10 +213,20 @@ extern Debug *debug;
 //      If flag is enabled, print a message.
 //----------------------------------------------------------------------
 #define DEBUG(flag,expr)                                                     \
-    if (!debug->IsEnabled(flag)) {} else { 				\
+    if (!DebugIsOn(flag)) {} else { 					\
         cerr << expr << "\n";   				        \
     }
 
+//----------------------------------------------------------------------
+// TRACE
+//      If flag is enabled, print or record event "event", with
+//	up to three int arguments.
+//----------------------------------------------------------------------
+#define TRACE(flag,event,...)                                              \
+    if (!DebugIsOn(flag)) {} else {                                      \
+        debug->Record(flag, event, __VA_ARGS__);                          \
+    }
+
 
 //----------------------------------------------------------------------
 // ASSERT
@@ -67,6 +239,7 @@ extern Debug *debug;
 #define ASSERT(condition)                                               \
     if (condition) {} else { 						\
 	cerr << "Assertion failed: line " << __LINE__ << " file " << __FILE__ << "\n";      \
+        if (debug != NULL) debug->SaveTrace();                                \
         Abort();                                                              \
     }
 
@@ -83,6 +256,7 @@ extern Debug *debug;
 #define ASSERTNOTREACHED()                                             \
     { 						\
 	cerr << "Assertion failed: line " << __LINE__ << " file " << __FILE__ << "\n";      \
+        if (debug != NULL) debug->SaveTrace();                                \
         Abort();                                                              \
     }
 
@@ -149,6 +149,21 @@ UDelay(unsigned int useconds)
 
 }
 
+//----------------------------------------------------------------------
+// HostTime
+// 	Return the time of day on the host, in seconds, to measure how
+//	long some part of the simulation takes to run.
+//----------------------------------------------------------------------
+
+double
+HostTime()
+{
+    struct timeval now;
+
+    (void) gettimeofday(&now, NULL);
+    return now.tv_sec + now.tv_usec / 1000000.0;
+}
+
 //----------------------------------------------------------------------
 // Abort
 // 	Quit and drop core.
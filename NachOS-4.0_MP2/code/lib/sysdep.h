@@ -25,6 +25,9 @@ extern void Exit(int exitCode);
 extern void Delay(int seconds);
 extern void UDelay(unsigned int usec);// rcgood - to avoid spinners.
 
+// Host wall-clock time in seconds, for timing benchmarks
+extern double HostTime();
+
 // Initialize system so that cleanUp routine is called when user hits ctl-C
 extern void CallOnUserAbort(void (*cleanup)(int));
 
@@ -61,6 +64,7 @@ double atof(const char *str);
 int abs(int i);
 void bcopy(const void *s1, void *s2, size_t n);
 void bzero(void *s, size_t n);
+int ffs(int i);
 }
 
 // Interprocess communication operations, for simulating the network
@@ -121,7 +121,7 @@ Disk::ReadRequest(int sectorNumber, char* data)
     DEBUG(dbgDisk, "Reading from sector " << sectorNumber);
     Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
     Read(fileno, data, SectorSize);
-    if (debug->IsEnabled('d'))
+    if (DebugIsOn('d'))
 	PrintSector(FALSE, sectorNumber, data);
     
     active = TRUE;
@@ -141,7 +141,7 @@ Disk::WriteRequest(int sectorNumber, char* data)
     DEBUG(dbgDisk, "Writing to sector " << sectorNumber);
     Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
     WriteFile(fileno, data, SectorSize);
-    if (debug->IsEnabled('d'))
+    if (DebugIsOn('d'))
 	PrintSector(TRUE, sectorNumber, data);
     
     active = TRUE;
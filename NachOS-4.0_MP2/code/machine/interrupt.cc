@@ -23,6 +23,8 @@
 #include "copyright.h"
 #include "interrupt.h"
 #include "main.h"
+#include "sysdep.h"
+#include "hostthread.h"
 
 // String definitions for debugging messages
 
@@ -59,7 +61,7 @@ PendingCompare (PendingInterrupt *x, PendingInterrupt *y)
 {
     if (x->when < y->when) { return -1; }
     else if (x->when > y->when) { return 1; }
-    else { return 0; }
+    else { return (int) (x->order - y->order); }  // ok if order wraps
 }
 
 //----------------------------------------------------------------------
@@ -72,9 +74,16 @@ PendingCompare (PendingInterrupt *x, PendingInterrupt *y)
 Interrupt::Interrupt()
 {
     level = IntOff;
-    pending = new SortedList<PendingInterrupt *>(PendingCompare);
+    maxPending = 16;
+    pending = new PendingInterrupt *[maxPending];
+    numPending = 0;
+    freePending = NULL;
+    numScheduled = 0;
+    nextDue = NeverDue;
     inHandler = FALSE;
     yieldOnReturn = FALSE;
+    preemptOnReturn = FALSE;
+    yieldReason = OwnYield;
     status = SystemMode;
 }
 
@@ -85,10 +94,17 @@ Interrupt::Interrupt()
 
 Interrupt::~Interrupt()
 {
-    while (!pending->IsEmpty()) {
-	delete pending->RemoveFront();
+    PendingInterrupt *toFree;
+
+    while (numPending > 0) {
+	delete Dequeue(0);
+    }
+    delete [] pending;
+    while (freePending != NULL) {
+	toFree = freePending;
+	freePending = toFree->nextFree;
+	delete toFree;
     }
-    delete pending;
 }
 
 //----------------------------------------------------------------------
@@ -143,6 +159,8 @@ Interrupt::SetLevel(IntStatus now)
 //	Two things can cause OneTick to be called:
 //		interrupts are re-enabled
 //		a user instruction is executed
+//
+//	On a multiprocessor, this is also where the CPUs take turns.
 //----------------------------------------------------------------------
 void
 Interrupt::OneTick()
@@ -154,11 +172,23 @@ Interrupt::OneTick()
     if (status == SystemMode) {
         stats->totalTicks += SystemTick;
 	stats->systemTicks += SystemTick;
-    } else {
+    } else if (status == UserMode) {
 	stats->totalTicks += UserTick;
 	stats->userTicks += UserTick;
+    }				// an idle CPU's time is charged when 
+				// it wakes (see SendIPI)
+    TRACE(dbgInt, TraceTick, stats->totalTicks);
+
+    if (kernel->numCpus > 1)
+	SwitchCpu();
+
+// nothing can fire before nextDue, and yieldOnReturn is only set by
+// interrupt handlers, so until then there is nothing more to do 
+// (unless we're tracing, and CheckIfDue would print the pending list)
+    if (stats->totalTicks < nextDue && !yieldOnReturn
+				&& !DebugIsOn(dbgInt)) {
+	return;
     }
-    DEBUG(dbgInt, "== Tick " << stats->totalTicks << " ==");
 
 // check any pending interrupts are now ready to fire
     ChangeLevel(IntOn, IntOff);	// first, turn off interrupts
@@ -168,9 +198,11 @@ Interrupt::OneTick()
     ChangeLevel(IntOff, IntOn);	// re-enable interrupts
     if (yieldOnReturn) {	// if the timer device handler asked 
     				// for a context switch, ok to do it now
-	yieldOnReturn = FALSE;
+	yieldReason = preemptOnReturn ? PreemptYield : SliceYield;
+	yieldOnReturn = preemptOnReturn = FALSE;
  	status = SystemMode;		// yield is a kernel routine
 	kernel->currentThread->Yield();
+	yieldReason = OwnYield;		// in case nothing else was ready
 	status = oldStatus;
     }
 }
@@ -184,13 +216,144 @@ Interrupt::OneTick()
 //	We can't do the context switch here, because that would switch
 //	out the interrupt handler, and we want to switch out the 
 //	interrupted thread.
+//
+//	"preempting" is set if the thread's time slice isn't up: a thread
+//	that should run first has been made ready.  It only makes a
+//	difference to what the switch is counted as.
 //----------------------------------------------------------------------
 
 void
-Interrupt::YieldOnReturn()
+Interrupt::YieldOnReturn(bool preempting)
 { 
     ASSERT(inHandler == TRUE);  
     yieldOnReturn = TRUE; 
+    if (preempting)
+	preemptOnReturn = TRUE;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::TakeYieldReason
+// 	Return why the running thread is yielding the CPU: because an
+//	interrupt handler asked it to (see YieldOnReturn), or of its own
+//	accord.  Called by Scheduler::Run, as the thread is switched out,
+//	so the next thread to yield does so of its own accord, unless
+//	it is asked to as well.
+//----------------------------------------------------------------------
+
+YieldReason
+Interrupt::TakeYieldReason()
+{
+    YieldReason reason = yieldReason;
+
+    yieldReason = OwnYield;
+    return reason;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::SendIPI
+// 	Interrupt another CPU of a multiprocessor, because there is a
+//	thread it should look at running.  The interrupt is taken when
+//	the CPU next gets its turn (see SwitchCpu), by calling its
+//	Cpu::CallBack.  If the CPU is idle, it starts taking turns
+//	again, from now.
+//
+//	When every CPU is idle, an interrupt handler may find work for
+//	the one that happens to be simulated; it only needs waking.
+//
+//	"cpu" -- the CPU to interrupt
+//----------------------------------------------------------------------
+
+void
+Interrupt::SendIPI(Cpu *cpu)
+{
+    Statistics *stats = kernel->stats;
+
+    if (cpu != kernel->cpu) {
+	DEBUG(dbgInt, "Sending an inter-processor interrupt to CPU " << cpu->id);
+	stats->numIPIs++;
+	cpu->ipiPending = TRUE;
+    }
+    if (cpu->idle) {
+	cpu->idle = FALSE;
+	cpu->idleTicks += stats->totalTicks - cpu->ticks;
+	cpu->ticks = stats->totalTicks;
+    }
+}
+
+//----------------------------------------------------------------------
+// Interrupt::SwitchCpu
+// 	Simulate the CPUs of a multiprocessor in lockstep: give the turn
+//	to whichever CPU has got least far in simulated time (the lowest
+//	numbered, if there is a tie), leaving out idle CPUs.  If every
+//	CPU is idle, roll time forward to the next interrupt, as Idle
+//	does on a uniprocessor.
+//
+//	Switching CPUs is a context switch between the threads the two
+//	CPUs are running, so we return when this CPU next gets its turn.
+//	Any inter-processor interrupt that came in the meantime is taken
+//	then.
+//----------------------------------------------------------------------
+
+void
+Interrupt::SwitchCpu()
+{
+    Statistics *stats = kernel->stats;
+    Cpu *from = kernel->cpu;
+    Cpu *to, *cpu;
+
+    if (!from->idle)
+	from->ticks = stats->totalTicks;
+    for (;;) {
+	to = NULL;
+	for (int i = 0; i < kernel->numCpus; i++) {
+	    cpu = kernel->cpus[i];
+	    if (!cpu->idle && (to == NULL || cpu->ticks < to->ticks))
+		to = cpu;
+	}
+	if (to != NULL)
+	    break;
+
+	// every CPU is waiting for an interrupt
+	ASSERT(level == IntOff);
+	if (!CheckIfDue(TRUE)) {
+	    DEBUG(dbgInt, "Machine idle.  No interrupts to do.");
+	    cout << "No threads ready or runnable, and no pending interrupts.\n";
+	    cout << "Assuming the program completed.\n";
+	    Halt();
+	}
+    }
+    if (to == from)
+	return;
+
+    DEBUG(dbgInt, "Switching from CPU " << from->id << " to CPU " << to->id
+		<< " at time " << to->ticks);
+    from->thread = kernel->currentThread;
+    from->status = status;
+    from->level = level;
+    kernel->cpu = to;
+    kernel->machine = to->machine;
+    kernel->alarm = to->alarm;
+    kernel->currentThread = to->thread;
+    status = to->status;
+    level = to->level;
+    stats->totalTicks = to->ticks;
+    if (kernel->hostThreads)
+	HostThread::Switch(from->thread, to->thread, FALSE);
+    else
+	SWITCH(from->thread, to->thread);
+
+    // our turn again
+    cpu = kernel->cpu;
+    if (cpu->ipiPending) {
+	IntStatus oldLevel = level;
+
+	cpu->ipiPending = FALSE;
+	ChangeLevel(oldLevel, IntOff);	// handlers run with interrupts off
+	inHandler = TRUE;
+	cpu->CallBack();
+	inHandler = FALSE;
+	ChangeLevel(IntOff, oldLevel);
+    }
 }
 
 //----------------------------------------------------------------------
@@ -209,14 +372,20 @@ Interrupt::Idle()
 {
     DEBUG(dbgInt, "Machine idling; checking for interrupts.");
     status = IdleMode;
-	DEBUG(dbgTraCode, "In Interrupt::Idle, into CheckIfDue, " << kernel->stats->totalTicks);
+    if (kernel->numCpus > 1) {	// let the other CPUs get on, until
+	kernel->cpu->idle = TRUE;	// one of them has work for us
+	kernel->cpu->ticks = kernel->stats->totalTicks;
+	SwitchCpu();
+	return;
+    }
+	TRACE(dbgTraCode, TraceIdleIn, kernel->stats->totalTicks);
     if (CheckIfDue(TRUE)) {	// check for any pending interrupts
-	DEBUG(dbgTraCode, "In Interrupt::Idle, return true from CheckIfDue, " << kernel->stats->totalTicks);
+	TRACE(dbgTraCode, TraceIdleTrue, kernel->stats->totalTicks);
 	status = SystemMode;
 	return;			// return in case there's now
 				// a runnable thread
     }
-	DEBUG(dbgTraCode, "In Interrupt::Idle, return false from CheckIfDue, " << kernel->stats->totalTicks);
+	TRACE(dbgTraCode, TraceIdleFalse, kernel->stats->totalTicks);
 
     // if there are no pending interrupts, and nothing is on the ready
     // queue, it is time to stop.   If the console or the network is 
@@ -239,6 +408,10 @@ Interrupt::Halt()
     cout << "Machine halting!\n\n";
     cout << "This is halt\n";
     kernel->stats->Print();
+    if (kernel->numCpus > 1) {
+	for (int i = 0; i < kernel->numCpus; i++)
+	    kernel->cpus[i]->Print();
+    }
     delete kernel;	// Never returns.
 }
 /*
@@ -284,7 +457,8 @@ Interrupt::CloseFile(OpenFileId id)
 // 	Arrange for the CPU to be interrupted when simulated time
 //	reaches "now + when".
 //
-//	Implementation: just put it on a sorted list.
+//	Implementation: put it on a binary heap ordered by when it is
+//	due (see Enqueue).
 //
 //	NOTE: the Nachos kernel should not call this routine directly.
 //	Instead, it is only called by the hardware device simulators.
@@ -298,12 +472,161 @@ void
 Interrupt::Schedule(CallBackObj *toCall, int fromNow, IntType type)
 {
     int when = kernel->stats->totalTicks + fromNow;
-    PendingInterrupt *toOccur = new PendingInterrupt(toCall, when, type);
 
     DEBUG(dbgInt, "Scheduling interrupt handler the " << intTypeNames[type] << " at time = " << when);
     ASSERT(fromNow > 0);
 
-    pending->Insert(toOccur);
+    Enqueue(toCall, when, type);
+}
+
+//----------------------------------------------------------------------
+// Interrupt::Cancel
+// 	Remove every interrupt of the given type that is scheduled to 
+//	call "toCall", so a device can take back an interrupt it no 
+//	longer wants.
+//
+//	Returns TRUE if anything was removed.
+//
+//	"toCall" is the object the interrupt would have called
+//	"type" is the hardware device that scheduled it
+//----------------------------------------------------------------------
+
+bool
+Interrupt::Cancel(CallBackObj *toCall, IntType type)
+{
+    bool found = FALSE;
+    int i = 0;
+
+    while (i < numPending) {
+	if (pending[i]->callOnInterrupt == toCall && pending[i]->type == type) {
+	    DEBUG(dbgInt, "Cancelling interrupt handler the " << intTypeNames[type] << " at time = " << pending[i]->when);
+	    Recycle(Dequeue(i));
+	    found = TRUE;
+	    i = 0;		// the heap has been reshuffled
+	} else {
+	    i++;
+	}
+    }
+    return found;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::Enqueue
+// 	Add an interrupt to the pending heap, reusing a record from the
+//	pool if there is one, and growing the heap if it is full.
+//
+//	"toCall" is the object to call when the interrupt occurs
+//	"when" is the time (not the delay) at which it should occur
+//	"type" is the hardware device that generated the interrupt
+//----------------------------------------------------------------------
+
+void
+Interrupt::Enqueue(CallBackObj *toCall, int when, IntType type)
+{
+    PendingInterrupt *toOccur;
+    PendingInterrupt **bigger;
+
+    if (freePending != NULL) {
+	toOccur = freePending;
+	freePending = toOccur->nextFree;
+	toOccur->callOnInterrupt = toCall;
+	toOccur->when = when;
+	toOccur->type = type;
+    } else {
+	toOccur = new PendingInterrupt(toCall, when, type);
+    }
+    toOccur->order = numScheduled++;
+
+    if (numPending == maxPending) {
+	bigger = new PendingInterrupt *[maxPending * 2];
+	bcopy(pending, bigger, numPending * sizeof(PendingInterrupt *));
+	delete [] pending;
+	pending = bigger;
+	maxPending *= 2;
+    }
+    pending[numPending] = toOccur;
+    SiftUp(numPending++);
+    nextDue = pending[0]->when;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::Dequeue
+// 	Remove the interrupt at position "index" in the pending heap
+//	(0 is the earliest), and return it.  The caller is responsible
+//	for giving the record back with Recycle.
+//----------------------------------------------------------------------
+
+PendingInterrupt *
+Interrupt::Dequeue(int index)
+{
+    PendingInterrupt *removed = pending[index];
+
+    ASSERT(index >= 0 && index < numPending);
+    numPending--;
+    if (index < numPending) {		// move the last entry into the gap
+	pending[index] = pending[numPending];
+	SiftDown(index);
+	SiftUp(index);
+    }
+    nextDue = (numPending > 0) ? pending[0]->when : NeverDue;
+    return removed;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::Recycle
+// 	Put a record that is no longer on the pending heap into the pool,
+//	for Enqueue to reuse.
+//----------------------------------------------------------------------
+
+void
+Interrupt::Recycle(PendingInterrupt *toFree)
+{
+    toFree->nextFree = freePending;
+    freePending = toFree;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::SiftUp, Interrupt::SiftDown
+// 	Move the entry at "index" towards the root (or the leaves) of 
+//	the pending heap until it is no earlier than its parent and no 
+//	later than its children.
+//----------------------------------------------------------------------
+
+void
+Interrupt::SiftUp(int index)
+{
+    PendingInterrupt *item = pending[index];
+    int parent;
+
+    while (index > 0) {
+	parent = (index - 1) / 2;
+	if (PendingCompare(item, pending[parent]) >= 0)
+	    break;
+	pending[index] = pending[parent];
+	index = parent;
+    }
+    pending[index] = item;
+}
+
+void
+Interrupt::SiftDown(int index)
+{
+    PendingInterrupt *item = pending[index];
+    int child;
+
+    for (;;) {
+	child = 2 * index + 1;
+	if (child >= numPending)
+	    break;
+	if (child + 1 < numPending 
+		&& PendingCompare(pending[child + 1], pending[child]) < 0)
+	    child++;
+	if (PendingCompare(pending[child], item) >= 0)
+	    break;
+	pending[index] = pending[child];
+	index = child;
+    }
+    pending[index] = item;
 }
 
 //----------------------------------------------------------------------
@@ -326,13 +649,13 @@ Interrupt::CheckIfDue(bool advanceClock)
 
     ASSERT(level == IntOff);		// interrupts need to be disabled,
 					// to invoke an interrupt handler
-    if (debug->IsEnabled(dbgInt)) {
+    if (DebugIsOn(dbgInt)) {
 	DumpState();
     }
-    if (pending->IsEmpty()) {   	// no pending interrupts
+    if (numPending == 0) {   	// no pending interrupts
 	return FALSE;	
     }		
-    next = pending->Front();
+    next = pending[0];
 
     if (next->when > stats->totalTicks) {
         if (!advanceClock) {		// not time yet
@@ -354,13 +677,13 @@ Interrupt::CheckIfDue(bool advanceClock)
 
     inHandler = TRUE;
     do {
-        next = pending->RemoveFront();    // pull interrupt off list
-		DEBUG(dbgTraCode, "In Interrupt::CheckIfDue, into callOnInterrupt->CallBack, " << stats->totalTicks);
+        next = Dequeue(0);    		// pull interrupt off the heap
+		TRACE(dbgTraCode, TraceCallBackIn, stats->totalTicks);
         next->callOnInterrupt->CallBack();// call the interrupt handler
-		DEBUG(dbgTraCode, "In Interrupt::CheckIfDue, return from callOnInterrupt->CallBack, " << stats->totalTicks);
-	delete next;
-    } while (!pending->IsEmpty() 
-    		&& (pending->Front()->when <= stats->totalTicks));
+		TRACE(dbgTraCode, TraceCallBackOut, stats->totalTicks);
+	Recycle(next);
+    } while ((numPending > 0) 
+    		&& (pending[0]->when <= stats->totalTicks));
     inHandler = FALSE;
     return TRUE;
 }
@@ -390,8 +713,140 @@ Interrupt::DumpState()
     cout << "Time: " << kernel->stats->totalTicks;
     cout << ", interrupts " << intLevelNames[level] << "\n";
     cout << "Pending interrupts:\n";
-    pending->Apply(PrintPending);
+    SortedList<PendingInterrupt *> inOrder(PendingCompare);
+    for (int i = 0; i < numPending; i++) {
+	inOrder.Insert(pending[i]);
+    }
+    inOrder.Apply(PrintPending);
     cout << "\nEnd of pending interrupts\n";
 }
 
 
+
+// A device that does nothing when it is interrupted, used to exercise
+// the pending interrupt queue on its own.
+class TestDevice : public CallBackObj {
+  public:
+    void CallBack() {}
+};
+
+//----------------------------------------------------------------------
+// Interrupt::SelfTest
+// 	Test the pending interrupt queue: interrupts must come off in
+//	order of when they are due, first come first served among those
+//	due at the same time, and Cancel must remove exactly the ones 
+//	asked for.  Uses a queue of its own, so it doesn't disturb the
+//	interrupts the devices have scheduled.
+//----------------------------------------------------------------------
+
+void
+Interrupt::SelfTest()
+{
+    Interrupt *queue = new Interrupt();
+    TestDevice devices[4];
+    PendingInterrupt *next, *prev;
+    int i;
+
+    for (i = 0; i < 100; i++) {
+	queue->Enqueue(&devices[i % 4], (i * 37) % 13, (IntType) (i % 2));
+    }
+    ASSERT(queue->NextDue() == 0);
+    for (prev = NULL; queue->numPending > 0; prev = next) {
+	next = queue->Dequeue(0);
+	if (prev != NULL) {
+	    ASSERT(prev->when < next->when || 
+			(prev->when == next->when && prev->order < next->order));
+	    queue->Recycle(prev);
+	}
+    }
+    queue->Recycle(prev);
+    ASSERT(queue->NextDue() == NeverDue);
+
+    for (i = 0; i < 20; i++) {
+	queue->Enqueue(&devices[i % 2], 100 - i, TimerInt);
+    }
+    ASSERT(queue->Cancel(&devices[0], TimerInt));
+    ASSERT(!queue->Cancel(&devices[0], TimerInt));
+    ASSERT(!queue->Cancel(&devices[1], DiskInt));
+    ASSERT(queue->numPending == 10 && queue->NextDue() == 100 - 19);
+    while (queue->numPending > 0) {
+	next = queue->Dequeue(0);
+	ASSERT(next->callOnInterrupt == &devices[1]);
+	queue->Recycle(next);
+    }
+    delete queue;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::Benchmark
+// 	Time the pending interrupt queue under a load like the one the 
+//	devices put on it: each device always has one interrupt pending,
+//	and when it fires the device schedules its next one a little
+//	later.  For comparison, run the same load on a sorted list with
+//	a new record per interrupt, which is how the queue used to work.
+//
+//	"numDevices" is how many devices are scheduling interrupts
+//	"numEvents" is how many interrupts to fire
+//----------------------------------------------------------------------
+
+void
+Interrupt::Benchmark(int numDevices, int numEvents)
+{
+    Interrupt *queue = new Interrupt();
+    SortedList<PendingInterrupt *> *list =
+		new SortedList<PendingInterrupt *>(PendingCompare);
+    TestDevice *devices = new TestDevice[numDevices];
+    PendingInterrupt *next, *toOccur;
+    unsigned int seed, scheduled = 0, heapSum = 0, listSum = 0;
+    int i, when;
+    double start, heapTime, listTime;
+
+// the time until a device next interrupts; a simple linear congruential
+// generator, so we don't disturb the one used for -rs
+#define NEXT_DELAY() (seed = seed * 1103515245 + 12345, 1 + (seed >> 16) % 1000)
+
+    seed = 1;
+    for (i = 0; i < numDevices; i++) {
+	queue->Enqueue(&devices[i], NEXT_DELAY(), TimerInt);
+    }
+    start = HostTime();
+    for (i = 0; i < numEvents; i++) {
+	next = queue->Dequeue(0);
+	heapSum += next->when;
+	queue->Enqueue(next->callOnInterrupt, next->when + NEXT_DELAY(),
+							next->type);
+	queue->Recycle(next);
+    }
+    heapTime = HostTime() - start;
+
+    seed = 1;
+    for (i = 0; i < numDevices; i++) {
+	toOccur = new PendingInterrupt(&devices[i], NEXT_DELAY(), TimerInt);
+	toOccur->order = scheduled++;
+	list->Insert(toOccur);
+    }
+    start = HostTime();
+    for (i = 0; i < numEvents; i++) {
+	next = list->RemoveFront();
+	listSum += next->when;
+	when = next->when + NEXT_DELAY();
+	toOccur = new PendingInterrupt(next->callOnInterrupt, when, next->type);
+	toOccur->order = scheduled++;
+	list->Insert(toOccur);
+	delete next;
+    }
+    listTime = HostTime() - start;
+#undef NEXT_DELAY
+
+    ASSERT(heapSum == listSum);		// same interrupts, same order
+    cout << "Interrupt queue, " << numDevices << " devices, " 
+	<< numEvents << " interrupts: heap " << heapTime 
+	<< " s, sorted list " << listTime << " s\n";
+
+    while (!list->IsEmpty()) {
+	delete list->RemoveFront();
+    }
+    delete list;
+    delete queue;
+    delete [] devices;
+}
@@ -37,6 +37,8 @@
 #include "list.h"
 #include "callback.h"
 
+class Cpu;
+
 // Interrupts can be disabled (IntOff) or enabled (IntOn)
 enum IntStatus { IntOff, IntOn };
 
@@ -51,6 +53,13 @@ enum MachineStatus {IdleMode, SystemMode, UserMode};
 enum IntType { TimerInt, DiskInt, ConsoleWriteInt, ConsoleReadInt, 
 			NetworkSendInt, NetworkRecvInt};
 
+// Why the running thread is giving up the CPU, when it yields (for
+// counting context switches; see Scheduler::Run).
+enum YieldReason { OwnYield, SliceYield, PreemptYield };
+
+// Returned by Interrupt::NextDue when no interrupt is pending.
+const int NeverDue = 0x7fffffff;
+
 // The following class defines an interrupt that is scheduled
 // to occur in the future.  The internal data structures are
 // left public to make it simpler to manipulate.
@@ -68,6 +77,10 @@ class PendingInterrupt {
     
     int when;			// When the interrupt is supposed to fire
     IntType type;		// for debugging
+    unsigned int order;		// when it was scheduled, relative to other
+				// interrupts; breaks ties in "when" so 
+				// they fire first come, first served
+    PendingInterrupt *nextFree;	// next in the pool of unused records
 };
 
 // The following class defines the data structures for the simulation
@@ -104,8 +117,19 @@ class Interrupt {
     int ReadFile(char *buffer, int size, OpenFileId id);
     int CloseFile(OpenFileId id);
  
-    void YieldOnReturn();	// cause a context switch on return 
-				// from an interrupt handler
+    void YieldOnReturn(bool preempting = FALSE);
+				// cause a context switch on return 
+				// from an interrupt handler; 
+				// "preempting" if the time slice 
+				// isn't up
+    YieldReason TakeYieldReason();
+				// why the running thread is yielding;
+				// OwnYield from then on
+    bool InHandler() { return inHandler; }
+				// running an interrupt handler?
+
+    void SendIPI(Cpu *cpu);	// interrupt another CPU, waking it
+				// if it is idle
 
     MachineStatus getStatus() { return status; } 
     void setStatus(MachineStatus st) { status = st; }
@@ -123,20 +147,43 @@ class Interrupt {
     				// Schedule an interrupt to occur
 				// at time "when".  This is called
     				// by the hardware device simulators.
+    bool Cancel(CallBackObj *callTo, IntType type);
+				// Remove any interrupts of this type
+				// scheduled for "callTo"; returns FALSE
+				// if there were none
     
     void OneTick();       	// Advance simulated time
 
+    int NextDue() { return nextDue; }
+				// Time of the earliest pending interrupt,
+				// or NeverDue if there is none
+
+    void SelfTest();		// Test the pending interrupt queue
+    void Benchmark(int numDevices, int numEvents);
+				// Time the pending interrupt queue
+				// against a sorted list
+
   private:
     IntStatus level;		// are interrupts enabled or disabled?
-    SortedList<PendingInterrupt *> *pending;		
-    				// the list of interrupts scheduled
-				// to occur in the future
+    PendingInterrupt **pending;	// the interrupts scheduled to occur
+				// in the future, as a binary heap 
+				// with the earliest at pending[0]
+    int numPending;		// number of entries in use in "pending"
+    int maxPending;		// size of the "pending" array
+    PendingInterrupt *freePending; // records to reuse, so we don't
+				// allocate one per Schedule
+    unsigned int numScheduled;	// source of PendingInterrupt::order
+    int nextDue;		// when pending[0] is due, kept up to 
+				// date so OneTick can skip looking at
+				// the queue until then
     //int writeFileNo;            //UNIX file emulating the display
     bool inHandler;		// TRUE if we are running an interrupt handler
     //bool putBusy;               // Is a PrintInt operation in progress
                                   //If so, you cannoot do another one
     bool yieldOnReturn; 	// TRUE if we are to context switch
 				// on return from the interrupt handler
+    bool preemptOnReturn;	// ... before the time slice is up
+    YieldReason yieldReason;	// why the running thread is yielding
     MachineStatus status;	// idle, kernel mode, user mode
 
     // these functions are internal to the interrupt simulation code
@@ -147,6 +194,19 @@ class Interrupt {
 
     void ChangeLevel(IntStatus old, 	// SetLevel, without advancing the
 			IntStatus now); // simulated time
+
+    void SwitchCpu();		// Let the CPU that has got least far
+				// in simulated time take its turn
+
+    void Enqueue(CallBackObj *callTo, int when, IntType type);
+				// Add an interrupt to the queue
+    PendingInterrupt *Dequeue(int index);
+				// Take an interrupt off the queue; 
+				// the caller must Recycle it
+    void Recycle(PendingInterrupt *toFree);
+				// Return a record to the pool
+    void SiftUp(int index);	// Restore the heap order around an
+    void SiftDown(int index);	// entry that has moved
 };
 
 #endif // INTERRRUPT_H
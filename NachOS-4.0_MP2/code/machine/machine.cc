@@ -61,20 +61,62 @@ Machine::Machine(bool debug)
     mainMemory = new char[MemorySize];
     for (i = 0; i < MemorySize; i++)
       	mainMemory[i] = 0;
-#ifdef USE_TLB
-    tlb = new TranslationEntry[TLBSize];
-    for (i = 0; i < TLBSize; i++)
-	tlb[i].valid = FALSE;
-    pageTable = NULL;
-#else	// use linear page table
-    tlb = NULL;
+    decodeCache = new Instruction[NumPhysPages * InstrsPerPage];
+    pageDecoded = new bool[NumPhysPages];
+    pageVersion = new int[NumPhysPages];
+    for (i = 0; i < NumPhysPages; i++) {
+	pageDecoded[i] = FALSE;
+	pageVersion[i] = 0;
+    }
+    blockTable = new TranslatedBlock *[NumPhysPages * InstrsPerPage];
+    for (i = 0; i < NumPhysPages * InstrsPerPage; i++)
+	blockTable[i] = NULL;
+    InvalidateTranslations();
+    traceAddr = DebugIsOn(dbgAddr);
+    tlb = NULL;			// use a linear page table, unless the
+    tlbSize = 0;		// kernel calls ConfigureTLB
+    tlbStamp = NULL;
+    tlbClock = 0;
+    tlbSeed = 1;
     pageTable = NULL;
-#endif
 
     singleStep = debug;
+    profile = NULL;
+    sharesMemory = FALSE;
     CheckEndian();
 }
 
+//----------------------------------------------------------------------
+// Machine::Machine
+// 	Initialize another CPU of a multiprocessor: with registers and
+//	a TLB of its own, but the same main memory as "other".  The
+//	simulator's pre-decoded and translated copies of memory are
+//	shared too, so a write by any CPU invalidates them for all.
+//----------------------------------------------------------------------
+
+Machine::Machine(Machine *other)
+{
+    for (int i = 0; i < NumTotalRegs; i++)
+        registers[i] = 0;
+    mainMemory = other->mainMemory;
+    decodeCache = other->decodeCache;
+    pageDecoded = other->pageDecoded;
+    pageVersion = other->pageVersion;
+    blockTable = other->blockTable;
+    InvalidateTranslations();
+    traceAddr = other->traceAddr;
+    tlb = NULL;
+    tlbSize = 0;
+    tlbStamp = NULL;
+    tlbClock = 0;
+    tlbSeed = 1;
+    pageTable = NULL;
+
+    singleStep = other->singleStep;
+    profile = NULL;
+    sharesMemory = TRUE;
+}
+
 //----------------------------------------------------------------------
 // Machine::~Machine
 // 	De-allocate the data structures used to simulate user program execution.
@@ -82,9 +124,122 @@ Machine::Machine(bool debug)
 
 Machine::~Machine()
 {
-    delete [] mainMemory;
-    if (tlb != NULL)
+    if (!sharesMemory) {
+	delete [] mainMemory;
+	delete [] decodeCache;
+	delete [] pageDecoded;
+	delete [] pageVersion;
+	for (int i = 0; i < NumPhysPages * InstrsPerPage; i++)
+	    delete blockTable[i];
+	delete [] blockTable;
+    }
+    if (tlb != NULL) {
         delete [] tlb;
+	delete [] tlbStamp;
+    }
+}
+
+//----------------------------------------------------------------------
+// Machine::ConfigureTLB
+// 	Translate addresses with a software-managed TLB instead of a
+//	linear page table.  All entries start out invalid; the kernel
+//	fills them in as TLB misses (PageFaultException) occur, using
+//	RefillTLB.
+//
+//	"size" -- the number of TLB entries
+//	"ways" -- the number of entries in each set, which must divide
+//		"size"; 0 (or "size") makes the TLB fully associative.
+//		At least two are needed, since one instruction can need
+//		both its own page and the page it loads or stores.
+//	"policy" -- how to choose the entry to replace on a refill
+//----------------------------------------------------------------------
+
+void
+Machine::ConfigureTLB(int size, int ways, TLBPolicy policy)
+{
+    ASSERT(size > 0 && pageTable == NULL);
+    if (ways <= 0 || ways > size)
+	ways = size;
+    ASSERT(ways >= 2 && size % ways == 0);
+
+    if (tlb != NULL) {
+	delete [] tlb;
+	delete [] tlbStamp;
+    }
+    tlb = new TranslationEntry[size];
+    tlbStamp = new unsigned int[size];
+    for (int i = 0; i < size; i++) {
+	tlb[i].valid = FALSE;
+	tlbStamp[i] = 0;
+    }
+    tlbSize = size;
+    tlbWays = ways;
+    tlbPolicy = policy;
+    InvalidateTranslations();
+}
+
+//----------------------------------------------------------------------
+// Machine::RefillTLB
+// 	Load a translation into the set of TLB entries it belongs in.
+//	An invalid entry is used if there is one; otherwise one is 
+//	chosen by the replacement policy.  The hardware sets the use and
+//	dirty bits in the TLB's copy, so the entry being replaced is 
+//	copied to "evicted", for the kernel to merge back into its own
+//	tables.
+//
+//	Returns the index of the TLB entry that was loaded.
+//
+//	"entry" -- the translation to load
+//	"evicted" -- where to put the old contents of the TLB entry
+//----------------------------------------------------------------------
+
+int
+Machine::RefillTLB(TranslationEntry *entry, TranslationEntry *evicted)
+{
+    int first = (entry->virtualPage % (tlbSize / tlbWays)) * tlbWays;
+    int victim = -1;
+    int i;
+
+    ASSERT(tlb != NULL);
+    for (i = first; i < first + tlbWays; i++) {
+	if (!tlb[i].valid) {
+	    victim = i;
+	    break;
+	}
+    }
+    if (victim == -1) {
+	if (tlbPolicy == TLBRandom) {
+	    tlbSeed = tlbSeed * 1103515245 + 12345;
+	    victim = first + (tlbSeed >> 16) % tlbWays;
+	} else {		// FIFO and LRU: the smallest stamp
+	    victim = first;
+	    for (i = first + 1; i < first + tlbWays; i++) {
+		if (tlbStamp[i] < tlbStamp[victim])
+		    victim = i;
+	    }
+	}
+    }
+    TRACE(dbgAddr, TraceTLBLoad, victim, entry->virtualPage);
+    *evicted = tlb[victim];
+    tlb[victim] = *entry;
+    tlbStamp[victim] = ++tlbClock;
+    InvalidateTranslations();
+    return victim;
+}
+
+//----------------------------------------------------------------------
+// Machine::FlushTLB
+// 	Invalidate every entry in the TLB, e.g. when switching to a 
+//	different address space.  Any use and dirty bits the kernel
+//	cares about must have been copied out first.
+//----------------------------------------------------------------------
+
+void
+Machine::FlushTLB()
+{
+    for (int i = 0; i < tlbSize; i++)
+	tlb[i].valid = FALSE;
+    InvalidateTranslations();
 }
 
 //----------------------------------------------------------------------
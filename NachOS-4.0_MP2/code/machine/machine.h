@@ -39,6 +39,15 @@ const int NumPhysPages = 128;
 
 const int MemorySize = (NumPhysPages * PageSize);
 const int TLBSize = 4;			// if there is a TLB, make it small
+					// (default size, see -tlb)
+const int TransCacheSize = 64;		// recent translations remembered by
+					// the simulator; a power of two
+
+// How a software-managed TLB picks the entry to replace, when all the
+// entries a page could go in are in use.
+enum TLBPolicy { TLBFifo,		// the one loaded longest ago
+		 TLBLru,		// the one used longest ago
+		 TLBRandom };		// any of them
 
 enum ExceptionType { NoException,           // Everything ok!
 		     SyscallException,      // A program executed a system call.
@@ -88,13 +97,79 @@ enum ExceptionType { NoException,           // Everything ok!
 // The procedures in this class are defined in machine.cc, mipssim.cc, and
 // translate.cc.
 
-class Instruction;
+// The following class defines an instruction, represented in both
+// 	undecoded binary form
+//      decoded to identify
+//	    operation to do
+//	    registers to act on
+//	    any immediate operand value
+
+class Instruction {
+  public:
+    void Decode();	// decode the binary representation of the instruction
+
+    unsigned int value; // binary representation of the instruction
+
+    char opCode;     // Type of instruction.  This is NOT the same as the
+    		     // opcode field from the instruction: see defs in mips.h
+    char rs, rt, rd; // Three registers from instruction.
+    int extra;       // Immediate or target or shamt field or offset.
+                     // Immediates are sign-extended.
+};
+
+// The following class defines an entry in the simulator's own cache
+// of recent address translations, indexed by virtual page number.
+// It lets ReadMem, WriteMem and instruction fetch skip most of
+// Translate.  An entry is only used while the page table or TLB
+// entry it was made from still says the same thing.
+
+class CachedTranslation {
+  public:
+    int virtualPage;		// -1 if the slot is empty
+    TranslationEntry *entry;	// page table or TLB entry it came from
+    int physicalPage;		// entry->physicalPage when it was cached
+    char *hostPage;		// &mainMemory[physicalPage * PageSize]
+};
+
+// Number of instructions held by one page of physical memory; the
+// simulator keeps pre-decoded copies of each page it executes from.
+const int InstrsPerPage = PageSize / 4;
+
+// The following classes define a translated basic block: a run of
+// straight-line instructions, within one physical page, ending with
+// the delay slot of the first branch or jump (or at the end of the
+// page).  Each instruction is turned into a micro-op that carries
+// the address of the code that executes it, so the block can be run
+// by jumping directly from one handler to the next.
+
+class MicroOp {
+  public:
+    void *handler;	// code that executes this op (set by RunBlock)
+    int extra;		// immediate, target, shift amount or offset
+    char opCode;	// as in Instruction
+    char rs, rt, rd;
+};
+
+class TranslatedBlock {
+  public:
+    int physAddr;	// physical address of the first instruction
+    int version;	// pageVersion of its page when it was translated
+    bool threaded;	// have the handler addresses been filled in?
+    int numOps;		// number of instructions in the block
+    MicroOp ops[InstrsPerPage];
+    TranslatedBlock *chain;	// the block that ran after this one last
+				// time, tried first before a table lookup
+};
+
 class Interrupt;
+class Profile;
 
 class Machine {
   public:
     Machine(bool debug);	// Initialize the simulation of the hardware
 				// for running user programs
+    Machine(Machine *other);	// Initialize another CPU, sharing
+				// memory with "other"
     ~Machine();			// De-allocate the data structures
 
 // Routines callable by the Nachos kernel
@@ -125,6 +200,8 @@ class Machine {
 // If "tlb" is non-NULL, the Nachos kernel is responsible for managing
 //	the contents of the TLB.  But the kernel can use any data structure
 //	it wants (eg, segmented paging) for handling TLB cache misses.
+//	The TLB is "tlbSize" entries, split into sets of "tlbWays" 
+//	entries; a page can only be held in set (vpn % number of sets).
 // 
 // For simplicity, both the page table pointer and the TLB pointer are
 // public.  However, while there can be multiple page tables (one per address
@@ -134,23 +211,63 @@ class Machine {
 
     TranslationEntry *tlb;		// this pointer should be considered 
 					// "read-only" to Nachos kernel code
+    int tlbSize;			// so should this
+
+    void ConfigureTLB(int size, int ways, TLBPolicy policy);
+					// Use a TLB of "size" entries, 
+					// "ways"-way set associative (0 for
+					// fully associative), rather than 
+					// a page table
+    int RefillTLB(TranslationEntry *entry, TranslationEntry *evicted);
+					// Load a translation into the TLB,
+					// replacing an entry according to
+					// the policy; the old contents are
+					// copied to "evicted"
+    void FlushTLB();			// Invalidate every TLB entry
 
     TranslationEntry *pageTable;
     unsigned int pageTableSize;
 
+    Profile *profile;		// told of every instruction run, if
+				// the address space is being profiled
+
     bool ReadMem(int addr, int size, int* value);
     bool WriteMem(int addr, int size, int value);
     				// Read or write 1, 2, or 4 bytes of virtual 
 				// memory (at addr).  Return FALSE if a 
 				// correct translation couldn't be found.
+
+    void InvalidateTranslations();
+				// Forget all cached translations; call
+				// after switching page tables or 
+				// changing the TLB
+
+    void InvalidateDecoded(int physAddr, int size);
+				// The kernel wrote "size" bytes of 
+				// mainMemory at "physAddr" behind the 
+				// simulator's back; drop any pre-decoded
+				// instructions for the pages touched.
   private:
 
 // Routines internal to the machine simulation -- DO NOT call these directly
     void DelayedLoad(int nextReg, int nextVal);  	
 				// Do a pending delayed load (modifying a reg)
 
-    void OneInstruction(Instruction *instr); 	
+    void OneInstruction(); 	
     				// Run one instruction of a user program.
+
+    Instruction *DecodePage(int pageFrame);
+				// Decode every instruction in a physical
+				// page into the decoded-instruction cache
+
+    TranslatedBlock *FindBlock(TranslatedBlock *hint);
+				// Return the translated block starting
+				// at the current PC, translating it if
+				// need be; NULL if it can't be run as a
+				// block right now
+    void RunBlock(TranslatedBlock *block);
+				// Run a block, and any blocks chained
+				// after it, up to the next interrupt
     
 
 
@@ -160,6 +277,10 @@ class Machine {
 				// the translation entry appropriately,
     				// and return an exception code if the 
 				// translation couldn't be completed.
+    CachedTranslation *LookupTranslation(int virtAddr, bool writing);
+				// Find a cached translation that is still
+				// good for this access, and set its use
+				// and dirty bits; NULL if there isn't one
 
     void RaiseException(ExceptionType which, int badVAddr);
 				// Trap to the Nachos kernel, because of a
@@ -173,6 +294,30 @@ class Machine {
 
     int registers[NumTotalRegs]; // CPU registers, for executing user programs
 
+    Instruction *decodeCache;	// pre-decoded copy of each physical page,
+				// InstrsPerPage entries per page frame
+    bool *pageDecoded;		// is the decodeCache entry for a page
+				// frame up to date?  Cleared whenever
+				// the page is written.
+    int *pageVersion;		// bumped each time a page is re-decoded,
+				// to invalidate its translated blocks
+    TranslatedBlock **blockTable; // translated blocks, indexed by the
+				// physical word address they start at
+    CachedTranslation transCache[TransCacheSize];
+				// recent translations, by vpn mod size
+    bool traceAddr;		// printing address translation debug
+				// messages?  If so, skip transCache.
+
+    int tlbWays;		// entries per TLB set
+    TLBPolicy tlbPolicy;	// which entry of a set RefillTLB replaces
+    unsigned int *tlbStamp;	// per entry: tlbClock when it was loaded
+				// (or, for LRU, last used)
+    unsigned int tlbClock;	// counts TLB loads (and, for LRU, hits)
+    unsigned int tlbSeed;	// for TLBRandom; kept apart from the
+				// generator used by -rs
+
+    bool sharesMemory;		// is mainMemory another CPU's?
+
     bool singleStep;		// drop back into the debugger after each
 				// simulated instruction
     int runUntilTime;		// drop back into the debugger when simulated
@@ -20,29 +20,79 @@
 #include "debug.h"
 #include "machine.h"
 #include "mipssim.h"
+#include "profile.h"
 #include "main.h"
 
 static void Mult(int a, int b, bool signedArith, int* hiPtr, int* loPtr);
 
-// The following class defines an instruction, represented in both
-// 	undecoded binary form
-//      decoded to identify
-//	    operation to do
-//	    registers to act on
-//	    any immediate operand value
+// How to print each instruction, for debugging, by opcode (see mipsops.h)
 
-class Instruction {
-  public:
-    void Decode();	// decode the binary representation of the instruction
-
-    unsigned int value; // binary representation of the instruction
-
-    char opCode;     // Type of instruction.  This is NOT the same as the
-    		     // opcode field from the instruction: see defs in mips.h
-    char rs, rt, rd; // Three registers from instruction.
-    int extra;       // Immediate or target or shamt field or offset.
-                     // Immediates are sign-extended.
-};
+struct OpString opStrings[] = {
+	{"Shouldn't happen", {NONE, NONE, NONE}},
+	{"ADD r%d,r%d,r%d", {RD, RS, RT}},
+	{"ADDI r%d,r%d,%d", {RT, RS, EXTRA}},
+	{"ADDIU r%d,r%d,%d", {RT, RS, EXTRA}},
+	{"ADDU r%d,r%d,r%d", {RD, RS, RT}},
+	{"AND r%d,r%d,r%d", {RD, RS, RT}},
+	{"ANDI r%d,r%d,%d", {RT, RS, EXTRA}},
+	{"BEQ r%d,r%d,%d", {RS, RT, EXTRA}},
+	{"BGEZ r%d,%d", {RS, EXTRA, NONE}},
+	{"BGEZAL r%d,%d", {RS, EXTRA, NONE}},
+	{"BGTZ r%d,%d", {RS, EXTRA, NONE}},
+	{"BLEZ r%d,%d", {RS, EXTRA, NONE}},
+	{"BLTZ r%d,%d", {RS, EXTRA, NONE}},
+	{"BLTZAL r%d,%d", {RS, EXTRA, NONE}},
+	{"BNE r%d,r%d,%d", {RS, RT, EXTRA}},
+	{"Shouldn't happen", {NONE, NONE, NONE}},
+	{"DIV r%d,r%d", {RS, RT, NONE}},
+	{"DIVU r%d,r%d", {RS, RT, NONE}},
+	{"J %d", {EXTRA, NONE, NONE}},
+	{"JAL %d", {EXTRA, NONE, NONE}},
+	{"JALR r%d,r%d", {RD, RS, NONE}},
+	{"JR r%d,r%d", {RD, RS, NONE}},
+	{"LB r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"LBU r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"LH r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"LHU r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"LUI r%d,%d", {RT, EXTRA, NONE}},
+	{"LW r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"LWL r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"LWR r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"Shouldn't happen", {NONE, NONE, NONE}},
+	{"MFHI r%d", {RD, NONE, NONE}},
+	{"MFLO r%d", {RD, NONE, NONE}},
+	{"Shouldn't happen", {NONE, NONE, NONE}},
+	{"MTHI r%d", {RS, NONE, NONE}},
+	{"MTLO r%d", {RS, NONE, NONE}},
+	{"MULT r%d,r%d", {RS, RT, NONE}},
+	{"MULTU r%d,r%d", {RS, RT, NONE}},
+	{"NOR r%d,r%d,r%d", {RD, RS, RT}},
+	{"OR r%d,r%d,r%d", {RD, RS, RT}},
+	{"ORI r%d,r%d,%d", {RT, RS, EXTRA}},
+	{"RFE", {NONE, NONE, NONE}},
+	{"SB r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"SH r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"SLL r%d,r%d,%d", {RD, RT, EXTRA}},
+	{"SLLV r%d,r%d,r%d", {RD, RT, RS}},
+	{"SLT r%d,r%d,r%d", {RD, RS, RT}},
+	{"SLTI r%d,r%d,%d", {RT, RS, EXTRA}},
+	{"SLTIU r%d,r%d,%d", {RT, RS, EXTRA}},
+	{"SLTU r%d,r%d,r%d", {RD, RS, RT}},
+	{"SRA r%d,r%d,%d", {RD, RT, EXTRA}},
+	{"SRAV r%d,r%d,r%d", {RD, RT, RS}},
+	{"SRL r%d,r%d,%d", {RD, RT, EXTRA}},
+	{"SRLV r%d,r%d,r%d", {RD, RT, RS}},
+	{"SUB r%d,r%d,r%d", {RD, RS, RT}},
+	{"SUBU r%d,r%d,r%d", {RD, RS, RT}},
+	{"SW r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"SWL r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"SWR r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"XOR r%d,r%d,r%d", {RD, RS, RT}},
+	{"XORI r%d,r%d,%d", {RT, RS, EXTRA}},
+	{"SYSCALL", {NONE, NONE, NONE}},
+	{"Unimplemented", {NONE, NONE, NONE}},
+	{"Reserved", {NONE, NONE, NONE}}
+      };
 
 //----------------------------------------------------------------------
 // Machine::Run
@@ -51,26 +101,56 @@ class Instruction {
 //
 //	This routine is re-entrant, in that it can be called multiple
 //	times concurrently -- one for each thread executing user code.
+//
+//	Whenever it can, a whole translated block is run at a time, with
+//	a single interrupt check at its end.  This is only done if the
+//	block will finish before the next interrupt is due, so the
+//	simulation behaves exactly as if it were run an instruction at a
+//	time.  Single-stepping, profiling, and tracing anything that is
+//	printed per instruction, always go through OneInstruction.  So
+//	does a multiprocessor, whose CPUs take turns every instruction.
+//
+//	A thread may be switched out at any tick, and on a multiprocessor
+//	it may be switched back in on a different CPU, so the machine we
+//	were called on is not necessarily the one to carry on with.
 //----------------------------------------------------------------------
 void
 Machine::Run()
 {
-    Instruction *instr = new Instruction;  // storage for decoded instruction
-    if (debug->IsEnabled('m')) {
+    Machine *machine = this;
+    TranslatedBlock *block;
+    bool tracing = DebugIsOn(dbgMach) || DebugIsOn(dbgInt) ||
+		DebugIsOn(dbgAddr) || DebugIsOn(dbgTraCode);
+    bool lockstep = kernel->numCpus > 1;
+
+    if (DebugIsOn('m')) {
         cout << "Starting program in thread: " << kernel->currentThread->getName();
 	cout << ", at time: " << kernel->stats->totalTicks << "\n";
     }
     kernel->interrupt->setStatus(UserMode);
     for (;;) {
-	DEBUG(dbgTraCode, "In Machine::Run(), into OneInstruction " << "== Tick " << kernel->stats->totalTicks << " ==");
-        OneInstruction(instr);
-	DEBUG(dbgTraCode, "In Machine::Run(), return from OneInstruction  " << "== Tick " << kernel->stats->totalTicks << " ==");
+	if (!machine->singleStep && !tracing && !lockstep 
+				&& machine->profile == NULL) {
+	    block = machine->FindBlock(NULL);
+	    if (block != NULL && kernel->stats->totalTicks
+			+ block->numOps * UserTick <= kernel->interrupt->NextDue()) {
+		machine->RunBlock(block);
+		kernel->interrupt->OneTick();	// for the last instruction
+		continue;
+	    }
+	}
+	TRACE(dbgTraCode, TraceRunInstrIn, kernel->stats->totalTicks);
+        machine->OneInstruction();
+	TRACE(dbgTraCode, TraceRunInstrOut, kernel->stats->totalTicks);
 		
-	DEBUG(dbgTraCode, "In Machine::Run(), into OneTick " << "== Tick " << kernel->stats->totalTicks << " ==");
+	TRACE(dbgTraCode, TraceRunTickIn, kernel->stats->totalTicks);
 	kernel->interrupt->OneTick();
-	DEBUG(dbgTraCode, "In Machine::Run(), return from OneTick " << "== Tick " << kernel->stats->totalTicks << " ==");
-	if (singleStep && (runUntilTime <= kernel->stats->totalTicks))
-		Debugger();
+	TRACE(dbgTraCode, TraceRunTickOut, kernel->stats->totalTicks);
+	machine = kernel->machine;	// we may have been moved to
+					// another CPU while switched out
+	if (machine->singleStep && (machine->runUntilTime 
+					<= kernel->stats->totalTicks))
+		machine->Debugger();
     }
 }
 
@@ -118,27 +198,40 @@ TypeToReg(RegType reg, Instruction *instr)
 //	leaving.  This allows the Nachos kernel to control our behavior
 //	by controlling the contents of memory, the translation table,
 //	and the register set.
+//
+//	The one exception is the decoded-instruction cache, which is
+//	keyed by physical page and thrown away whenever the page is 
+//	written, so it always agrees with the contents of memory.
 //----------------------------------------------------------------------
 
 void
-Machine::OneInstruction(Instruction *instr)
+Machine::OneInstruction()
 {
 #ifdef SIM_FIX
     int byte;       // described in Kane for LWL,LWR,...
 #endif
 
-    int raw;
+    Instruction *instr;
+    int physAddr;
+    ExceptionType exception;
     int nextLoadReg = 0; 	
     int nextLoadValue = 0; 	// record delayed load operation, to apply
 				// in the future
 
-    // Fetch instruction 
-    if (!ReadMem(registers[PCReg], 4, &raw))
+    // Fetch instruction.  The PC is still translated, so page faults
+    // and the use bit behave exactly as for ReadMem, but the word itself
+    // comes out of the decoded-instruction cache.
+    exception = Translate(registers[PCReg], &physAddr, 4, FALSE);
+    if (exception != NoException) {
+	RaiseException(exception, registers[PCReg]);
 	return;			// exception occurred
-    instr->value = raw;
-    instr->Decode();
+    }
+    if (pageDecoded[physAddr / PageSize])
+	instr = &decodeCache[physAddr / 4];
+    else
+	instr = DecodePage(physAddr / PageSize) + (physAddr % PageSize) / 4;
 
-    if (debug->IsEnabled('m')) {
+    if (DebugIsOn('m')) {
         struct OpString *str = &opStrings[instr->opCode];
 	char buf[80];
 
@@ -671,7 +764,7 @@ Machine::OneInstruction(Instruction *instr)
 	break;
     	
       case OP_SYSCALL:
-	DEBUG(dbgTraCode, "In Machine::OneInstruction, RaiseException(SyscallException, 0), " << kernel->stats->totalTicks);
+	TRACE(dbgTraCode, TraceSyscall, kernel->stats->totalTicks);
 	RaiseException(SyscallException, 0);
 	return; 
 	
@@ -696,6 +789,9 @@ Machine::OneInstruction(Instruction *instr)
     
     // Do any delayed load operation
     DelayedLoad(nextLoadReg, nextLoadValue);
+
+    if (profile != NULL)
+	profile->Step(instr, registers[PCReg], pcAfter);
     
     // Advance program counters.
     registers[PrevPCReg] = registers[PCReg];	// for debugging, in case we
@@ -721,6 +817,566 @@ Machine::DelayedLoad(int nextReg, int nextValue)
     registers[0] = 0; 	// and always make sure R0 stays zero.
 }
 
+//----------------------------------------------------------------------
+// Machine::DecodePage
+// 	Decode all the instructions in a page of physical memory into the
+//	decoded-instruction cache, and mark the page as decoded.  Data
+//	words are decoded too; they are simply never executed.
+//
+//	Returns the decoded copy of the first word in the page.
+//
+//	"pageFrame" -- the physical page to decode
+//----------------------------------------------------------------------
+
+Instruction *
+Machine::DecodePage(int pageFrame)
+{
+    Instruction *page = &decodeCache[pageFrame * InstrsPerPage];
+    unsigned int *words = (unsigned int *) &mainMemory[pageFrame * PageSize];
+
+    for (int i = 0; i < InstrsPerPage; i++) {
+	page[i].value = WordToHost(words[i]);
+	page[i].Decode();
+    }
+    pageDecoded[pageFrame] = TRUE;
+    pageVersion[pageFrame]++;		// its translated blocks are stale
+    return page;
+}
+
+//----------------------------------------------------------------------
+// KindOfOp
+// 	Classify an opcode for building translated blocks: NotInBlock if
+//	the instruction is left to OneInstruction (system calls, illegal
+//	instructions and the rarely used unaligned loads and stores),
+//	BranchOp if it ends a block after its delay slot, or PlainOp.
+//----------------------------------------------------------------------
+
+enum BlockOpKind { NotInBlock, PlainOp, BranchOp };
+
+static BlockOpKind
+KindOfOp(int opCode)
+{
+    switch (opCode) {
+      case OP_BEQ: case OP_BGEZ: case OP_BGEZAL: case OP_BGTZ:
+      case OP_BLEZ: case OP_BLTZ: case OP_BLTZAL: case OP_BNE:
+      case OP_J: case OP_JAL: case OP_JALR: case OP_JR:
+	return BranchOp;
+
+      case OP_LWL: case OP_LWR: case OP_SWL: case OP_SWR:
+      case OP_SYSCALL: case OP_RFE: case OP_RES: case OP_UNIMP:
+	return NotInBlock;
+
+      default:
+	return PlainOp;
+    }
+}
+
+//----------------------------------------------------------------------
+// Machine::FindBlock
+// 	Return the translated block that starts at the current PC,
+//	translating it from the decoded-instruction cache if there isn't
+//	an up-to-date one already.  A block is thrown away (by way of
+//	pageVersion) whenever the page it was translated from is
+//	re-decoded after being written.
+//
+//	Returns NULL if the next instruction must be run by OneInstruction:
+//	the PC doesn't translate (OneInstruction will raise the exception),
+//	we are in a delay slot, or the instruction can't start a block.
+//
+//	"hint" -- a block that is likely to be the one we want, or NULL
+//----------------------------------------------------------------------
+
+TranslatedBlock *
+Machine::FindBlock(TranslatedBlock *hint)
+{
+    int physAddr, frame, i;
+    TranslatedBlock *block;
+    Instruction *instr;
+    MicroOp *op;
+    bool inDelaySlot;
+
+    if (registers[NextPCReg] != registers[PCReg] + 4)
+	return NULL;
+    if (Translate(registers[PCReg], &physAddr, 4, FALSE) != NoException)
+	return NULL;
+    frame = physAddr / PageSize;
+    if (!pageDecoded[frame])
+	DecodePage(frame);
+
+    if (hint != NULL && hint->physAddr == physAddr 
+			&& hint->version == pageVersion[frame])
+	return hint;			// hint is never an empty block
+    
+    block = blockTable[physAddr / 4];
+    if (block == NULL) {
+	block = new TranslatedBlock;
+	block->physAddr = physAddr;
+	block->version = pageVersion[frame] - 1;
+	blockTable[physAddr / 4] = block;
+    }
+    if (block->version != pageVersion[frame]) {
+	block->version = pageVersion[frame];
+	block->threaded = FALSE;
+	block->chain = NULL;
+	block->numOps = 0;
+	inDelaySlot = FALSE;
+	for (i = (physAddr % PageSize) / 4; i < InstrsPerPage; i++) {
+	    instr = &decodeCache[frame * InstrsPerPage + i];
+	    if (KindOfOp(instr->opCode) == NotInBlock)
+		break;
+	    op = &block->ops[block->numOps++];
+	    op->opCode = instr->opCode;
+	    op->rs = instr->rs;
+	    op->rt = instr->rt;
+	    op->rd = instr->rd;
+	    op->extra = instr->extra;
+	    if (inDelaySlot)
+		break;
+	    inDelaySlot = (KindOfOp(instr->opCode) == BranchOp);
+	}
+    }
+    if (block->numOps == 0)
+	return NULL;
+    return block;
+}
+
+//----------------------------------------------------------------------
+// Machine::RunBlock
+// 	Run a translated block, and then any blocks that follow it, for
+//	as long as each can run to completion before the next interrupt
+//	is due.  The caller has checked this for the first block.
+//
+//	Each micro-op holds the address of its handler (filled in the
+//	first time the block runs), and each handler ends by jumping
+//	straight to the next one, rather than going back round a switch.
+//	The handlers do exactly what OneInstruction does for the same
+//	instruction, including the delayed load and the program counter
+//	updates, so the registers are always as the kernel expects.
+//
+//	Simulated time is charged as we go: before anything that can
+//	raise an exception, every instruction retired so far has been
+//	charged, so the kernel sees the same totalTicks as it would have
+//	running an instruction at a time.  After an exception, or when
+//	we run out of blocks, we return with the last instruction still
+//	to be charged; the caller does that with a call to OneTick.
+//----------------------------------------------------------------------
+
+void
+Machine::RunBlock(TranslatedBlock *block)
+{
+    static void *handlers[MaxOpcode + 1];
+    int *r = registers;
+    Statistics *stats = kernel->stats;
+    int due = kernel->interrupt->NextDue();
+    int done = 0;		// instructions retired but not yet charged
+    MicroOp *op, *end;
+    TranslatedBlock *next;
+    int pcAfter, nextLoadReg, nextLoadValue;
+    int sum, diff, tmp, value;
+    unsigned int rs, rt, imm;
+
+#define CHARGE_TICKS() \
+    { stats->totalTicks += done * UserTick;				\
+      stats->userTicks += done * UserTick; done = 0; }
+
+    if (handlers[OP_ADD] == NULL) {
+	handlers[OP_ADD] = &&op_add;
+	handlers[OP_ADDI] = &&op_addi;
+	handlers[OP_ADDIU] = &&op_addiu;
+	handlers[OP_ADDU] = &&op_addu;
+	handlers[OP_AND] = &&op_and;
+	handlers[OP_ANDI] = &&op_andi;
+	handlers[OP_BEQ] = &&op_beq;
+	handlers[OP_BGEZ] = &&op_bgez;
+	handlers[OP_BGEZAL] = &&op_bgezal;
+	handlers[OP_BGTZ] = &&op_bgtz;
+	handlers[OP_BLEZ] = &&op_blez;
+	handlers[OP_BLTZ] = &&op_bltz;
+	handlers[OP_BLTZAL] = &&op_bltzal;
+	handlers[OP_BNE] = &&op_bne;
+	handlers[OP_DIV] = &&op_div;
+	handlers[OP_DIVU] = &&op_divu;
+	handlers[OP_J] = &&op_j;
+	handlers[OP_JAL] = &&op_jal;
+	handlers[OP_JALR] = &&op_jalr;
+	handlers[OP_JR] = &&op_jr;
+	handlers[OP_LB] = &&op_lb;
+	handlers[OP_LBU] = &&op_lbu;
+	handlers[OP_LH] = &&op_lh;
+	handlers[OP_LHU] = &&op_lhu;
+	handlers[OP_LUI] = &&op_lui;
+	handlers[OP_LW] = &&op_lw;
+	handlers[OP_MFHI] = &&op_mfhi;
+	handlers[OP_MFLO] = &&op_mflo;
+	handlers[OP_MTHI] = &&op_mthi;
+	handlers[OP_MTLO] = &&op_mtlo;
+	handlers[OP_MULT] = &&op_mult;
+	handlers[OP_MULTU] = &&op_multu;
+	handlers[OP_NOR] = &&op_nor;
+	handlers[OP_OR] = &&op_or;
+	handlers[OP_ORI] = &&op_ori;
+	handlers[OP_SB] = &&op_sb;
+	handlers[OP_SH] = &&op_sh;
+	handlers[OP_SLL] = &&op_sll;
+	handlers[OP_SLLV] = &&op_sllv;
+	handlers[OP_SLT] = &&op_slt;
+	handlers[OP_SLTI] = &&op_slti;
+	handlers[OP_SLTIU] = &&op_sltiu;
+	handlers[OP_SLTU] = &&op_sltu;
+	handlers[OP_SRA] = &&op_sra;
+	handlers[OP_SRAV] = &&op_srav;
+	handlers[OP_SRL] = &&op_srl;
+	handlers[OP_SRLV] = &&op_srlv;
+	handlers[OP_SUB] = &&op_sub;
+	handlers[OP_SUBU] = &&op_subu;
+	handlers[OP_SW] = &&op_sw;
+	handlers[OP_XOR] = &&op_xor;
+	handlers[OP_XORI] = &&op_xori;
+    }
+
+  startBlock:
+    op = block->ops;
+    end = op + block->numOps;
+    if (!block->threaded) {
+	for (; op < end; op++) {
+	    ASSERT(handlers[(int) op->opCode] != NULL);
+	    op->handler = handlers[(int) op->opCode];
+	}
+	block->threaded = TRUE;
+	op = block->ops;
+    }
+    pcAfter = r[NextPCReg] + 4;
+    goto *op->handler;
+
+  op_add:
+    sum = r[op->rs] + r[op->rt];
+    if (!((r[op->rs] ^ r[op->rt]) & SIGN_BIT) &&
+	((r[op->rs] ^ sum) & SIGN_BIT)) {
+	CHARGE_TICKS();
+	RaiseException(OverflowException, 0);
+	return;
+    }
+    r[op->rd] = sum;
+    goto retire;
+
+  op_addi:
+    sum = r[op->rs] + op->extra;
+    if (!((r[op->rs] ^ op->extra) & SIGN_BIT) &&
+	((op->extra ^ sum) & SIGN_BIT)) {
+	CHARGE_TICKS();
+	RaiseException(OverflowException, 0);
+	return;
+    }
+    r[op->rt] = sum;
+    goto retire;
+
+  op_addiu:
+    r[op->rt] = r[op->rs] + op->extra;
+    goto retire;
+
+  op_addu:
+    r[op->rd] = r[op->rs] + r[op->rt];
+    goto retire;
+
+  op_and:
+    r[op->rd] = r[op->rs] & r[op->rt];
+    goto retire;
+
+  op_andi:
+    r[op->rt] = r[op->rs] & (op->extra & 0xffff);
+    goto retire;
+
+  op_beq:
+    if (r[op->rs] == r[op->rt])
+	pcAfter = r[NextPCReg] + IndexToAddr(op->extra);
+    goto retire;
+
+  op_bgezal:
+    r[R31] = r[NextPCReg] + 4;
+  op_bgez:
+    if (!(r[op->rs] & SIGN_BIT))
+	pcAfter = r[NextPCReg] + IndexToAddr(op->extra);
+    goto retire;
+
+  op_bgtz:
+    if (r[op->rs] > 0)
+	pcAfter = r[NextPCReg] + IndexToAddr(op->extra);
+    goto retire;
+
+  op_blez:
+    if (r[op->rs] <= 0)
+	pcAfter = r[NextPCReg] + IndexToAddr(op->extra);
+    goto retire;
+
+  op_bltzal:
+    r[R31] = r[NextPCReg] + 4;
+  op_bltz:
+    if (r[op->rs] & SIGN_BIT)
+	pcAfter = r[NextPCReg] + IndexToAddr(op->extra);
+    goto retire;
+
+  op_bne:
+    if (r[op->rs] != r[op->rt])
+	pcAfter = r[NextPCReg] + IndexToAddr(op->extra);
+    goto retire;
+
+  op_div:
+    if (r[op->rt] == 0) {
+	r[LoReg] = 0;
+	r[HiReg] = 0;
+    } else {
+	r[LoReg] = r[op->rs] / r[op->rt];
+	r[HiReg] = r[op->rs] % r[op->rt];
+    }
+    goto retire;
+
+  op_divu:
+    rs = (unsigned int) r[op->rs];
+    rt = (unsigned int) r[op->rt];
+    if (rt == 0) {
+	r[LoReg] = 0;
+	r[HiReg] = 0;
+    } else {
+	tmp = rs / rt;
+	r[LoReg] = (int) tmp;
+	tmp = rs % rt;
+	r[HiReg] = (int) tmp;
+    }
+    goto retire;
+
+  op_jal:
+    r[R31] = r[NextPCReg] + 4;
+  op_j:
+    pcAfter = (pcAfter & 0xf0000000) | IndexToAddr(op->extra);
+    goto retire;
+
+  op_jalr:
+    r[op->rd] = r[NextPCReg] + 4;
+  op_jr:
+    pcAfter = r[op->rs];
+    goto retire;
+
+  op_lb:
+  op_lbu:
+    CHARGE_TICKS();
+    if (!ReadMem(r[op->rs] + op->extra, 1, &value))
+	return;
+    if ((value & 0x80) && (op->opCode == OP_LB))
+	value |= 0xffffff00;
+    else
+	value &= 0xff;
+    nextLoadReg = op->rt;
+    nextLoadValue = value;
+    goto retireLoad;
+
+  op_lh:
+  op_lhu:
+    tmp = r[op->rs] + op->extra;
+    CHARGE_TICKS();
+    if (tmp & 0x1) {
+	RaiseException(AddressErrorException, tmp);
+	return;
+    }
+    if (!ReadMem(tmp, 2, &value))
+	return;
+    if ((value & 0x8000) && (op->opCode == OP_LH))
+	value |= 0xffff0000;
+    else
+	value &= 0xffff;
+    nextLoadReg = op->rt;
+    nextLoadValue = value;
+    goto retireLoad;
+
+  op_lui:
+    r[op->rt] = op->extra << 16;
+    goto retire;
+
+  op_lw:
+    tmp = r[op->rs] + op->extra;
+    CHARGE_TICKS();
+    if (tmp & 0x3) {
+	RaiseException(AddressErrorException, tmp);
+	return;
+    }
+    if (!ReadMem(tmp, 4, &value))
+	return;
+    nextLoadReg = op->rt;
+    nextLoadValue = value;
+    goto retireLoad;
+
+  op_mfhi:
+    r[op->rd] = r[HiReg];
+    goto retire;
+
+  op_mflo:
+    r[op->rd] = r[LoReg];
+    goto retire;
+
+  op_mthi:
+    r[HiReg] = r[op->rs];
+    goto retire;
+
+  op_mtlo:
+    r[LoReg] = r[op->rs];
+    goto retire;
+
+  op_mult:
+    Mult(r[op->rs], r[op->rt], TRUE, &r[HiReg], &r[LoReg]);
+    goto retire;
+
+  op_multu:
+    Mult(r[op->rs], r[op->rt], FALSE, &r[HiReg], &r[LoReg]);
+    goto retire;
+
+  op_nor:
+    r[op->rd] = ~(r[op->rs] | r[op->rt]);
+    goto retire;
+
+  op_or:
+    r[op->rd] = r[op->rs] | r[op->rt];
+    goto retire;
+
+  op_ori:
+    r[op->rt] = r[op->rs] | (op->extra & 0xffff);
+    goto retire;
+
+  op_sb:
+    CHARGE_TICKS();
+    if (!WriteMem((unsigned) (r[op->rs] + op->extra), 1, r[op->rt]))
+	return;
+    goto retireStore;
+
+  op_sh:
+    CHARGE_TICKS();
+    if (!WriteMem((unsigned) (r[op->rs] + op->extra), 2, r[op->rt]))
+	return;
+    goto retireStore;
+
+  op_sll:
+    r[op->rd] = r[op->rt] << op->extra;
+    goto retire;
+
+  op_sllv:
+    r[op->rd] = r[op->rt] << (r[op->rs] & 0x1f);
+    goto retire;
+
+  op_slt:
+    if (r[op->rs] < r[op->rt])
+	r[op->rd] = 1;
+    else
+	r[op->rd] = 0;
+    goto retire;
+
+  op_slti:
+    if (r[op->rs] < op->extra)
+	r[op->rt] = 1;
+    else
+	r[op->rt] = 0;
+    goto retire;
+
+  op_sltiu:
+    rs = r[op->rs];
+    imm = op->extra;
+    if (rs < imm)
+	r[op->rt] = 1;
+    else
+	r[op->rt] = 0;
+    goto retire;
+
+  op_sltu:
+    rs = r[op->rs];
+    rt = r[op->rt];
+    if (rs < rt)
+	r[op->rd] = 1;
+    else
+	r[op->rd] = 0;
+    goto retire;
+
+  op_sra:
+    r[op->rd] = r[op->rt] >> op->extra;
+    goto retire;
+
+  op_srav:
+    r[op->rd] = r[op->rt] >> (r[op->rs] & 0x1f);
+    goto retire;
+
+  op_srl:
+    tmp = r[op->rt];
+    tmp >>= op->extra;
+    r[op->rd] = tmp;
+    goto retire;
+
+  op_srlv:
+    tmp = r[op->rt];
+    tmp >>= (r[op->rs] & 0x1f);
+    r[op->rd] = tmp;
+    goto retire;
+
+  op_sub:
+    diff = r[op->rs] - r[op->rt];
+    if (((r[op->rs] ^ r[op->rt]) & SIGN_BIT) &&
+	((r[op->rs] ^ diff) & SIGN_BIT)) {
+	CHARGE_TICKS();
+	RaiseException(OverflowException, 0);
+	return;
+    }
+    r[op->rd] = diff;
+    goto retire;
+
+  op_subu:
+    r[op->rd] = r[op->rs] - r[op->rt];
+    goto retire;
+
+  op_sw:
+    CHARGE_TICKS();
+    if (!WriteMem((unsigned) (r[op->rs] + op->extra), 4, r[op->rt]))
+	return;
+    goto retireStore;
+
+  op_xor:
+    r[op->rd] = r[op->rs] ^ r[op->rt];
+    goto retire;
+
+  op_xori:
+    r[op->rt] = r[op->rs] ^ (op->extra & 0xffff);
+    goto retire;
+
+  retireStore:
+    // If the store hit the page we are running from, the rest of the
+    // block may be out of date; finish the instruction and stop.
+    if (!pageDecoded[block->physAddr / PageSize])
+	end = op + 1;
+  retire:
+    nextLoadReg = 0;
+    nextLoadValue = 0;
+  retireLoad:
+    r[r[LoadReg]] = r[LoadValueReg];	// as in DelayedLoad
+    r[LoadReg] = nextLoadReg;
+    r[LoadValueReg] = nextLoadValue;
+    r[0] = 0;
+    r[PrevPCReg] = r[PCReg];
+    r[PCReg] = r[NextPCReg];
+    r[NextPCReg] = pcAfter;
+    done++;
+    if (++op < end) {
+	pcAfter = r[NextPCReg] + 4;
+	goto *op->handler;
+    }
+
+    // End of the block: chain on to the next one if it, too, will
+    // finish before the next interrupt.
+    next = FindBlock(block->chain);
+    if (next != NULL
+	&& stats->totalTicks + (done + next->numOps) * UserTick <= due) {
+	block->chain = next;
+	block = next;
+	goto startBlock;
+    }
+    done--;			// the caller's OneTick charges the last one
+    CHARGE_TICKS();
+#undef CHARGE_TICKS
+}
+
 //----------------------------------------------------------------------
 // Instruction::Decode
 // 	Decode a MIPS instruction 
@@ -22,6 +22,16 @@ Statistics::Statistics()
     numDiskReads = numDiskWrites = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
+    numSwapReads = numSwapWrites = 0;
+    numPagesCopied = 0;
+    numFramesInUse = maxFramesInUse = 0;
+    numTLBHits = numTLBMisses = numTLBRefills = 0;
+    numTimerInts = 0;
+    numIPIs = numMigrations = 0;
+    numThreadsDone = turnaroundTicks = responseTicks = readyTicks = 0;
+    numSwitches = numVoluntarySwitches = numInvoluntarySwitches = 0;
+    numPreemptions = 0;
+    switchWindow = windowSwitches = 0;
 }
 
 //----------------------------------------------------------------------
@@ -40,6 +50,102 @@ Statistics::Print()
 		cout << "Console I/O: reads " << numConsoleCharsRead;
     cout << ", writes " << numConsoleCharsWritten << "\n";
     cout << "Paging: faults " << numPageFaults << "\n";
+    cout << "Timer: interrupts " << numTimerInts << "\n";
+    if (maxFramesInUse > 0) {
+	cout << "Memory: frames in use " << numFramesInUse;
+	cout << ", high water " << maxFramesInUse << "\n";
+    }
+    if (numSwapReads + numSwapWrites > 0) {
+	cout << "Swap I/O: reads " << numSwapReads;
+	cout << ", writes " << numSwapWrites << "\n";
+    }
+    if (numPagesCopied > 0)
+	cout << "Copy-on-write: pages copied " << numPagesCopied << "\n";
+    if (numTLBHits + numTLBMisses > 0) {
+	cout << "TLB: hits " << numTLBHits << ", misses " << numTLBMisses;
+	cout << ", refills " << numTLBRefills << "\n";
+    }
+    if (numThreadsDone > 0) {
+	cout << "Threads: finished " << numThreadsDone;
+	cout << ", average turnaround " << turnaroundTicks / numThreadsDone;
+	cout << ", response " << responseTicks / numThreadsDone;
+	cout << ", ready " << readyTicks / numThreadsDone << "\n";
+    }
+    if (numSwitches > 0) {
+	Histogram rate = switchRate;
+
+	rate.Add(windowSwitches);	// the window we're part way through
+	if (totalTicks / SwitchRateWindow > switchWindow)
+	    rate.Add(0, totalTicks / SwitchRateWindow - switchWindow);
+					// ... and those since, with none
+	cout << "Switches: total " << numSwitches;
+	cout << ", voluntary " << numVoluntarySwitches;
+	cout << ", involuntary " << numInvoluntarySwitches;
+	cout << ", preemptions " << numPreemptions << "\n";
+	readyLength.Print("Switches: threads left ready");
+	cout << "Switches: per " << SwitchRateWindow << " ticks";
+	rate.Print("");
+    }
+    if (numIPIs + numMigrations > 0) {
+	cout << "SMP: inter-processor interrupts " << numIPIs;
+	cout << ", migrations " << numMigrations << "\n";
+    }
     cout << "Network I/O: packets received " << numPacketsRecvd;
 		cout << ", sent " << numPacketsSent << "\n";
 }
+
+//----------------------------------------------------------------------
+// Histogram::Histogram
+// 	Initialize a histogram, with nothing counted.
+//----------------------------------------------------------------------
+
+Histogram::Histogram()
+{
+    for (int i = 0; i < HistogramBuckets; i++)
+	count[i] = 0;
+}
+
+//----------------------------------------------------------------------
+// Histogram::Add
+// 	Count "value", "times" times over, in the range it falls in.
+//----------------------------------------------------------------------
+
+void
+Histogram::Add(int value, int times)
+{
+    int bucket = 0;
+
+    ASSERT(value >= 0);
+    while (value > 0 && bucket < HistogramBuckets - 1) {
+	value >>= 1;
+	bucket++;
+    }
+    count[bucket] += times;
+}
+
+//----------------------------------------------------------------------
+// Histogram::Print
+// 	Print, after "title", how many values fell in each range, leaving
+//	out those none did.
+//----------------------------------------------------------------------
+
+void
+Histogram::Print(const char *title)
+{
+    int low, high;
+
+    cout << title;
+    for (int i = 0; i < HistogramBuckets; i++) {
+	if (count[i] == 0)
+	    continue;
+	low = (i == 0) ? 0 : 1 << (i - 1);
+	high = (1 << i) - 1;
+	cout << ", " << low;
+	if (i == HistogramBuckets - 1)
+	    cout << "+";
+	else if (high > low)
+	    cout << "-" << high;
+	cout << ": " << count[i];
+    }
+    cout << "\n";
+}
@@ -13,6 +13,27 @@
 
 #include "copyright.h"
 
+// How often a value fell in each of a few ranges: 0, 1, 2-3, 4-7, and
+// so on, doubling, with the last taking everything from 64 up.
+
+const int HistogramBuckets = 8;
+
+class Histogram {
+  public:
+    Histogram();		// nothing counted yet
+
+    void Add(int value, int times = 1);
+				// count "value", "times" times over
+    void Print(const char *title);
+				// print the ranges anything fell in
+
+  private:
+    int count[HistogramBuckets];
+};
+
+// How many ticks the switch rate is counted over, in Statistics::switchRate
+const int SwitchRateWindow = 1000;
+
 // The following class defines the statistics that are to be kept
 // about Nachos behavior -- how much time (ticks) elapsed, how
 // many user instructions executed, etc.
@@ -33,6 +54,33 @@ class Statistics {
     int numConsoleCharsRead;	// number of characters read from the keyboard
     int numConsoleCharsWritten; // number of characters written to the display
     int numPageFaults;		// number of virtual memory page faults
+    int numSwapReads;		// number of pages read in from swap
+    int numSwapWrites;		// number of pages written out to swap
+    int numPagesCopied;		// pages copied on a write after a Fork
+    int numFramesInUse;		// physical frames allocated right now
+    int maxFramesInUse;		// the most frames allocated at once
+    int numTLBHits;		// number of translations found in the TLB
+    int numTLBMisses;		// number of TLB misses taken by the kernel
+    int numTLBRefills;		// number of TLB entries loaded on a miss
+    int numTimerInts;		// number of timer interrupts taken
+    int numIPIs;		// number of inter-processor interrupts sent
+    int numMigrations;		// threads run on a different CPU from the
+				// one they last ran on
+    int numThreadsDone;		// threads that have finished, and
+    int turnaroundTicks;	// ... the time from when each was first
+				// made ready until it finished, summed
+    int responseTicks;		// ... until it first ran, summed
+    int readyTicks;		// ... that each spent ready but not
+				// running, summed
+    int numSwitches;		// context switches, of which threads
+    int numVoluntarySwitches;	// ... blocked, finished or yielded,
+    int numInvoluntarySwitches;	// ... were made to yield by an 
+				// interrupt handler,
+    int numPreemptions;		// ... before their time slice was up
+    Histogram readyLength;	// threads left ready, at each switch
+    Histogram switchRate;	// switches in each SwitchRateWindow ticks
+    int switchWindow;		// the window being counted in now
+    int windowSwitches;		// ... and how many switches so far
     int numPacketsSent;		// number of packets sent over the network
     int numPacketsRecvd;	// number of packets received over the network
 
@@ -40,6 +40,7 @@ Timer::Timer(bool doRandom, CallBackObj *toCall)
     randomize = doRandom;
     callPeriodically = toCall;
     disable = FALSE;
+    pending = FALSE;
     SetInterrupt();
 }
 
@@ -52,6 +53,7 @@ Timer::Timer(bool doRandom, CallBackObj *toCall)
 void 
 Timer::CallBack() 
 {
+    pending = FALSE;
     // invoke the Nachos interrupt handler for this device
     callPeriodically->CallBack();
     
@@ -77,5 +79,22 @@ Timer::SetInterrupt()
         }
        // schedule the next timer device interrupt
        kernel->interrupt->Schedule(this, delay, TimerInt);
+       pending = TRUE;
     }
 }
+
+//----------------------------------------------------------------------
+// Timer::Enable
+//      Turn the timer device back on, after Disable.  If it was
+//	turned off before its last interrupt came, that interrupt is
+//	still to come, and it carries on from there; otherwise it starts
+//	again, with an interrupt a full period from now.
+//----------------------------------------------------------------------
+
+void
+Timer::Enable()
+{
+    disable = FALSE;
+    if (!pending)
+	SetInterrupt();
+}
@@ -11,6 +11,9 @@
 //	In order to introduce some randomness into time-slicing, if "doRandom"
 //	is set, then the interrupt comes after a random number of ticks.
 //
+//	The timer can be turned off, and back on again, so that it only
+//	interrupts when the kernel has a use for it.
+//
 //  DO NOT CHANGE -- part of the machine emulation
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
@@ -35,12 +38,16 @@ class Timer : public CallBackObj {
     void Disable() { disable = TRUE; }
     				// Turn timer device off, so it doesn't
 				// generate any more interrupts.
+    void Enable();		// Turn it back on; an interrupt still
+				// pending is kept, otherwise the next
+				// comes a full period from now
 
   private:
     bool randomize;		// set if we need to use a random timeout delay
     CallBackObj *callPeriodically; // call this every TimerTicks time units 
     bool disable;		// turn off the timer device after next
     				// interrupt.
+    bool pending;		// is an interrupt scheduled?
     
     void CallBack();		// called internally when the hardware
 				// timer generates an interrupt
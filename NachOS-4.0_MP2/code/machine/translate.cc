@@ -88,34 +88,42 @@ Machine::ReadMem(int addr, int size, int *value)
     int data;
     ExceptionType exception;
     int physicalAddress;
+    char *hostAddr;
+    CachedTranslation *cached;
     
-    DEBUG(dbgAddr, "Reading VA " << addr << ", size " << size);
+    if (!traceAddr && (addr & (size - 1)) == 0 
+		&& (cached = LookupTranslation(addr, FALSE)) != NULL) {
+	hostAddr = cached->hostPage + (unsigned) addr % PageSize;
+    } else {
+	TRACE(dbgAddr, TraceReadMem, addr, size);
     
-    exception = Translate(addr, &physicalAddress, size, FALSE);
-    if (exception != NoException) {
-	RaiseException(exception, addr);
-	return FALSE;
+	exception = Translate(addr, &physicalAddress, size, FALSE);
+	if (exception != NoException) {
+	    RaiseException(exception, addr);
+	    return FALSE;
+	}
+	hostAddr = &mainMemory[physicalAddress];
     }
     switch (size) {
       case 1:
-	data = mainMemory[physicalAddress];
+	data = *hostAddr;
 	*value = data;
 	break;
 	
       case 2:
-	data = *(unsigned short *) &mainMemory[physicalAddress];
+	data = *(unsigned short *) hostAddr;
 	*value = ShortToHost(data);
 	break;
 	
       case 4:
-	data = *(unsigned int *) &mainMemory[physicalAddress];
+	data = *(unsigned int *) hostAddr;
 	*value = WordToHost(data);
 	break;
 
       default: ASSERT(FALSE);
     }
     
-    DEBUG(dbgAddr, "\tvalue read = " << *value);
+    TRACE(dbgAddr, TraceValueRead, *value);
     return (TRUE);
 }
 
@@ -137,26 +145,36 @@ Machine::WriteMem(int addr, int size, int value)
 {
     ExceptionType exception;
     int physicalAddress;
+    char *hostAddr;
+    CachedTranslation *cached;
      
-    DEBUG(dbgAddr, "Writing VA " << addr << ", size " << size << ", value " << value);
+    if (!traceAddr && (addr & (size - 1)) == 0 
+		&& (cached = LookupTranslation(addr, TRUE)) != NULL) {
+	pageDecoded[cached->physicalPage] = FALSE;	// may be code
+	hostAddr = cached->hostPage + (unsigned) addr % PageSize;
+    } else {
+	TRACE(dbgAddr, TraceWriteMem, addr, size, value);
 
-    exception = Translate(addr, &physicalAddress, size, TRUE);
-    if (exception != NoException) {
-	RaiseException(exception, addr);
-	return FALSE;
+	exception = Translate(addr, &physicalAddress, size, TRUE);
+	if (exception != NoException) {
+	    RaiseException(exception, addr);
+	    return FALSE;
+	}
+	pageDecoded[physicalAddress / PageSize] = FALSE;	// may be code
+	hostAddr = &mainMemory[physicalAddress];
     }
     switch (size) {
       case 1:
-	mainMemory[physicalAddress] = (unsigned char) (value & 0xff);
+	*hostAddr = (unsigned char) (value & 0xff);
 	break;
 
       case 2:
-	*(unsigned short *) &mainMemory[physicalAddress]
+	*(unsigned short *) hostAddr
 		= ShortToMachine((unsigned short) (value & 0xffff));
 	break;
       
       case 4:
-	*(unsigned int *) &mainMemory[physicalAddress]
+	*(unsigned int *) hostAddr
 		= WordToMachine((unsigned int) value);
 	break;
 	
@@ -166,6 +184,83 @@ Machine::WriteMem(int addr, int size, int value)
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// Machine::InvalidateDecoded
+//      Called by the kernel after it modifies user memory directly
+//	(loading a program, copying in a read buffer, ...) so that the
+//	simulator does not go on executing stale pre-decoded instructions.
+//
+//	"physAddr" -- the first byte of mainMemory that was modified
+//	"size" -- the number of bytes modified
+//----------------------------------------------------------------------
+
+void
+Machine::InvalidateDecoded(int physAddr, int size)
+{
+    int first, last;
+
+    if (size <= 0)
+	return;
+    first = physAddr / PageSize;
+    last = (physAddr + size - 1) / PageSize;
+    if (first < 0)
+	first = 0;
+    if (last >= NumPhysPages)
+	last = NumPhysPages - 1;
+    for (int frame = first; frame <= last; frame++)
+	pageDecoded[frame] = FALSE;
+}
+
+//----------------------------------------------------------------------
+// Machine::InvalidateTranslations
+// 	Empty the cache of recent translations.  The cache checks that
+//	the entry each translation came from is still valid and still
+//	maps to the same frame, but it can't tell when the entry itself
+//	stops being the one to use -- so this must be called whenever 
+//	the page table is switched, or the TLB is reloaded.
+//----------------------------------------------------------------------
+
+void
+Machine::InvalidateTranslations()
+{
+    for (int i = 0; i < TransCacheSize; i++)
+	transCache[i].virtualPage = -1;
+}
+
+//----------------------------------------------------------------------
+// Machine::LookupTranslation
+// 	Look for a cached translation of "virtAddr" that can be used for
+//	this access.  If there is one, set the use bit (and the dirty
+//	bit, if "writing") in the translation entry, just as Translate
+//	would, and return it.  Alignment is the caller's problem.
+//
+//	"virtAddr" -- the virtual address to translate
+// 	"writing" -- if TRUE, the page mustn't be read-only
+//----------------------------------------------------------------------
+
+CachedTranslation *
+Machine::LookupTranslation(int virtAddr, bool writing)
+{
+    unsigned int vpn = (unsigned) virtAddr / PageSize;
+    CachedTranslation *cached = &transCache[vpn % TransCacheSize];
+    TranslationEntry *entry = cached->entry;
+
+    if (cached->virtualPage != (int) vpn || !entry->valid 
+		|| entry->virtualPage != (int) vpn
+		|| entry->physicalPage != cached->physicalPage
+		|| (writing && entry->readOnly))
+	return NULL;
+    entry->use = TRUE;
+    if (writing)
+	entry->dirty = TRUE;
+    if (tlb != NULL) {
+	kernel->stats->numTLBHits++;
+	if (tlbPolicy == TLBLru)
+	    tlbStamp[entry - tlb] = ++tlbClock;
+    }
+    return cached;
+}
+
 //----------------------------------------------------------------------
 // Machine::Translate
 // 	Translate a virtual address into a physical address, using 
@@ -188,8 +283,17 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
     unsigned int vpn, offset;
     TranslationEntry *entry;
     unsigned int pageFrame;
+    CachedTranslation *cached;
+
+    if (!traceAddr && (virtAddr & (size - 1)) == 0 
+		&& (cached = LookupTranslation(virtAddr, writing)) != NULL) {
+	*physAddr = cached->physicalPage * PageSize 
+				+ (unsigned) virtAddr % PageSize;
+	return NoException;
+    }
 
-    DEBUG(dbgAddr, "\tTranslate " << virtAddr << (writing ? " , write" : " , read"));
+    TRACE(dbgAddr, writing ? TraceTranslateWrite : TraceTranslateRead,
+		virtAddr);
 
 // check for alignment errors
     if (((size == 4) && (virtAddr & 0x3)) || ((size == 2) && (virtAddr & 0x1))){
@@ -214,8 +318,10 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
 	    return PageFaultException;
 	}
 	entry = &pageTable[vpn];
-    } else {
-        for (entry = NULL, i = 0; i < TLBSize; i++)
+    } else {			// look in the set the page maps to
+	int first = (vpn % (tlbSize / tlbWays)) * tlbWays;
+
+        for (entry = NULL, i = first; i < first + tlbWays; i++)
     	    if (tlb[i].valid && (tlb[i].virtualPage == ((int)vpn))) {
 		entry = &tlb[i];			// FOUND!
 		break;
@@ -226,6 +332,9 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
 						// the page may be in memory,
 						// but not in the TLB
 	}
+	kernel->stats->numTLBHits++;
+	if (tlbPolicy == TLBLru)
+	    tlbStamp[i] = ++tlbClock;
     }
 
     if (entry->readOnly && writing) {	// trying to write to a read-only page
@@ -244,7 +353,15 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
     if (writing)
 	entry->dirty = TRUE;
     *physAddr = pageFrame * PageSize + offset;
+
+    if (entry->virtualPage == (int) vpn) {	// remember it for next time
+	cached = &transCache[vpn % TransCacheSize];
+	cached->virtualPage = vpn;
+	cached->entry = entry;
+	cached->physicalPage = pageFrame;
+	cached->hostPage = &mainMemory[pageFrame * PageSize];
+    }
     ASSERT((*physAddr >= 0) && ((*physAddr + size) <= MemorySize));
-    DEBUG(dbgAddr, "phys addr = " << *physAddr);
+    TRACE(dbgAddr, TracePhysAddr, *physAddr);
     return NoException;
 }
@@ -125,7 +125,7 @@ MailBox::Get(PacketHeader *pktHdr, MailHeader *mailHdr, char *data)
 
     *pktHdr = mail->pktHdr;
     *mailHdr = mail->mailHdr;
-    if (debug->IsEnabled('n')) {
+    if (DebugIsOn('n')) {
 	cout << "Got mail from mailbox: ";
 	PrintHeader(*pktHdr, *mailHdr);
     }
@@ -201,7 +201,7 @@ PostOfficeInput::PostalDelivery(void* data)
         pktHdr = _this->network->Receive(buffer);
 
         mailHdr = *(MailHeader *)buffer;
-        if (debug->IsEnabled('n')) {
+        if (DebugIsOn('n')) {
 	    cout << "Putting mail into mailbox: ";
 	    PrintHeader(pktHdr, mailHdr);
         }
@@ -302,7 +302,7 @@ PostOfficeOutput::Send(PacketHeader pktHdr, MailHeader mailHdr, char* data)
     char* buffer = new char[MaxPacketSize];	// space to hold concatenated
 						// mailHdr + data
 
-    if (debug->IsEnabled('n')) {
+    if (DebugIsOn('n')) {
 	cout << "Post send: ";
 	PrintHeader(pktHdr, mailHdr);
     }
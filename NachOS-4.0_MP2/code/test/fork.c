@@ -0,0 +1,31 @@
+/* fork.c
+ *	Simple program to test Fork and Join, and copy-on-write.
+ *
+ *	The child changes a variable the parent has already touched,
+ *	which must not change the parent's copy; the parent writes to
+ *	the same page once the child is gone.  Expect 99, 7, 5, 42.
+ */
+
+#include "syscall.h"
+
+int shared[2] = { 5, 0 };
+
+int
+main()
+{
+    SpaceId child;
+    int first = shared[0];		/* bring the page in before the fork */
+
+    child = Fork();
+    if (child == 0) {
+	shared[0] = 99;			/* gets a copy of the page */
+	PrintInt(shared[0]);
+	Exit(7);
+    }
+
+    PrintInt(Join(child));
+    shared[1] = 42;			/* ours alone by now */
+    PrintInt(shared[0]);
+    PrintInt(shared[1]);
+    Exit(first - 5);
+}
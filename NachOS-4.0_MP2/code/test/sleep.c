@@ -0,0 +1,21 @@
+/* sleep.c
+ *	Simple program to test Sleep.
+ *
+ *	Sleeps a while between printing each number, so that copies of
+ *	it run alongside each other take turns, and the machine idles
+ *	while they all sleep.  Expect 1, 2, 3.
+ */
+
+#include "syscall.h"
+
+int
+main()
+{
+    int i;
+
+    for (i = 1; i <= 3; i++) {
+	Sleep(1000);
+	PrintInt(i);
+    }
+    Exit(0);
+}
@@ -1,8 +1,7 @@
 // alarm.cc
 //	Routines to use a hardware timer device to provide a
-//	software alarm clock.  For now, we just provide time-slicing.
-//
-//	Not completely implemented.
+//	software alarm clock: time-slicing, and threads sleeping for a
+//	while (see WaitUntil).
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -18,11 +17,14 @@
 //
 //      "doRandom" -- if true, arrange for the hardware interrupts to 
 //		occur at random, instead of fixed, intervals.
+//	"cpu" -- the CPU whose timer it is
 //----------------------------------------------------------------------
 
-Alarm::Alarm(bool doRandom)
+Alarm::Alarm(bool doRandom, Cpu *cpu)
 {
+    this->cpu = cpu;
     timer = new Timer(doRandom, this);
+    sleepers = new SleepQueue;
 }
 
 //----------------------------------------------------------------------
@@ -39,8 +41,16 @@ Alarm::Alarm(bool doRandom)
 //	if the interrupted thread called Yield at the point it is 
 //	was interrupted.
 //
-//	For now, just provide time-slicing.  Only need to time slice 
-//      if we're currently running something (in other words, not idle).
+//	For now, just provide time-slicing, whenever the scheduler says
+//	the running thread has had long enough (see ShouldPreempt).  Only
+//	need to time slice if we're currently running something (in
+//	other words, not idle).
+//
+//	The interrupt may come while another CPU is being simulated;
+//	if so, pass it on to ours.
+//
+//	If no thread is waiting for the CPU, there is nothing to time-
+//	slice, so turn the timer off until one is (see StartSlicing).
 //----------------------------------------------------------------------
 
 void 
@@ -49,7 +59,255 @@ Alarm::CallBack()
     Interrupt *interrupt = kernel->interrupt;
     MachineStatus status = interrupt->getStatus();
     
-    if (status != IdleMode) {
+    kernel->stats->numTimerInts++;
+    if (cpu != kernel->cpu) {
+	if (!cpu->idle) {
+	    cpu->sliceUp = TRUE;
+	    interrupt->SendIPI(cpu);
+	}
+    } else if (status != IdleMode && kernel->scheduler->ShouldPreempt()) {
 	interrupt->YieldOnReturn();
     }
+    if (kernel->scheduler->NumReady(cpu->id) == 0)
+	timer->Disable();
+}
+
+//----------------------------------------------------------------------
+// Alarm::WaitUntil
+// 	Put the current thread to sleep for "x" ticks of simulated time.
+//	Other threads run meanwhile; if there are none, the CPU idles
+//	until the thread is woken up, by an interrupt at time now + x.
+//----------------------------------------------------------------------
+
+void
+Alarm::WaitUntil(int x)
+{
+    IntStatus oldLevel;
+
+    if (x <= 0)
+	return;
+    oldLevel = kernel->interrupt->SetLevel(IntOff);
+    DEBUG(dbgThread, "Thread " << kernel->currentThread->getName() 
+	<< " sleeping for " << x << " ticks");
+    sleepers->Insert(kernel->currentThread, kernel->stats->totalTicks + x);
+    kernel->currentThread->Sleep(FALSE);
+    (void) kernel->interrupt->SetLevel(oldLevel);
+}
+
+// How long the threads the self test puts to sleep sleep for, and when
+// they were due to wake up, in the order they did.
+static int sleepTestDelays[] = { 300, 100, 250, 100 };
+static const int NumSleepTests = 4;
+static int sleepTestDue[NumSleepTests];
+static int numSleepTestWoken;
+
+//----------------------------------------------------------------------
+// SleepTestThread
+// 	Sleep for as long as the self test says to, and check we aren't
+//	woken up early.
+//----------------------------------------------------------------------
+
+static void
+SleepTestThread(int which)
+{
+    int due = kernel->stats->totalTicks + sleepTestDelays[which];
+
+    kernel->alarm->WaitUntil(sleepTestDelays[which]);
+    ASSERT(kernel->stats->totalTicks >= due);
+    sleepTestDue[numSleepTestWoken++] = due;
+}
+
+//----------------------------------------------------------------------
+// Alarm::SelfTest
+// 	Put several threads to sleep for different lengths of time, and
+//	check they all wake up, and in the order they were due to.
+//----------------------------------------------------------------------
+
+void
+Alarm::SelfTest()
+{
+    Thread *t;
+
+    DEBUG(dbgThread, "Entering Alarm::SelfTest");
+    numSleepTestWoken = 0;
+    for (int i = 0; i < NumSleepTests; i++) {
+	t = new Thread("sleeper", i);
+	t->Fork((VoidFunctionPtr) SleepTestThread, (void *) i);
+    }
+    kernel->alarm->WaitUntil(1000);
+    ASSERT(numSleepTestWoken == NumSleepTests);
+    for (int i = 1; i < NumSleepTests; i++)
+	ASSERT(sleepTestDue[i - 1] <= sleepTestDue[i]);
+}
+
+//----------------------------------------------------------------------
+// SleepQueue::SleepQueue
+// 	Initialize an empty queue of sleeping threads.
+//----------------------------------------------------------------------
+
+SleepQueue::SleepQueue()
+{
+    maxSleeping = 8;
+    heap = new Sleeper[maxSleeping];
+    numSleeping = 0;
+    numInserted = 0;
+    armedFor = NeverDue;
+}
+
+//----------------------------------------------------------------------
+// SleepQueue::~SleepQueue
+// 	De-allocate the queue.  Nachos is halting, so any threads still
+//	asleep are never woken up.
+//----------------------------------------------------------------------
+
+SleepQueue::~SleepQueue()
+{
+    delete [] heap;
+}
+
+//----------------------------------------------------------------------
+// SleepQueue::NextWakeUp
+// 	Return when the first sleeping thread is to wake up, or NeverDue
+//	if no thread is sleeping.
+//----------------------------------------------------------------------
+
+int
+SleepQueue::NextWakeUp()
+{
+    return (numSleeping > 0) ? heap[0].when : NeverDue;
+}
+
+//----------------------------------------------------------------------
+// SleepQueue::Insert
+// 	Queue a thread to be woken up at a given time, and make sure an
+//	interrupt is scheduled for then, if it is the first due.  Called
+//	with interrupts disabled; the caller puts the thread to sleep.
+//
+//	"thread" -- the thread going to sleep
+//	"when" -- the time, in the future, to wake it up
+//----------------------------------------------------------------------
+
+void
+SleepQueue::Insert(Thread *thread, int when)
+{
+    Sleeper *bigger;
+
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    ASSERT(when > kernel->stats->totalTicks);
+    if (numSleeping == maxSleeping) {
+	bigger = new Sleeper[maxSleeping * 2];
+	bcopy(heap, bigger, numSleeping * sizeof(Sleeper));
+	delete [] heap;
+	heap = bigger;
+	maxSleeping *= 2;
+    }
+    heap[numSleeping].when = when;
+    heap[numSleeping].order = numInserted++;
+    heap[numSleeping].thread = thread;
+    SiftUp(numSleeping++);
+    Arm();
+}
+
+//----------------------------------------------------------------------
+// SleepQueue::CallBack
+// 	The interrupt for the first wake-up time has come: make every
+//	thread that is due ready to run, and schedule the interrupt
+//	again for the next one.
+//----------------------------------------------------------------------
+
+void
+SleepQueue::CallBack()
+{
+    int now = kernel->stats->totalTicks;
+    Thread *thread;
+
+    armedFor = NeverDue;		// that was it going off
+    while (numSleeping > 0 && heap[0].when <= now) {
+	thread = heap[0].thread;
+	DEBUG(dbgThread, "Waking up thread " << thread->getName() 
+	    << ", due at " << heap[0].when);
+	heap[0] = heap[--numSleeping];
+	if (numSleeping > 0)
+	    SiftDown(0);
+	kernel->scheduler->ReadyToRun(thread);
+    }
+    Arm();
+}
+
+//----------------------------------------------------------------------
+// SleepQueue::Arm
+// 	Make sure the interrupt is scheduled for when the first thread
+//	is due, and for no other time.
+//----------------------------------------------------------------------
+
+void
+SleepQueue::Arm()
+{
+    int when = NextWakeUp();
+
+    if (when == armedFor)
+	return;
+    if (armedFor != NeverDue)
+	(void) kernel->interrupt->Cancel(this, TimerInt);
+    armedFor = when;
+    if (when != NeverDue)
+	kernel->interrupt->Schedule(this, when - kernel->stats->totalTicks,
+								TimerInt);
+}
+
+//----------------------------------------------------------------------
+// SleeperCompare
+// 	Order sleepers by wake-up time, then by when they went to sleep.
+//----------------------------------------------------------------------
+
+static int
+SleeperCompare(Sleeper *x, Sleeper *y)
+{
+    if (x->when != y->when)
+	return (x->when < y->when) ? -1 : 1;
+    return (x->order < y->order) ? -1 : ((x->order > y->order) ? 1 : 0);
+}
+
+//----------------------------------------------------------------------
+// SleepQueue::SiftUp, SleepQueue::SiftDown
+// 	Move the entry at "index" towards the root (or the leaves) of 
+//	the heap until it is due no earlier than its parent and no 
+//	later than its children.
+//----------------------------------------------------------------------
+
+void
+SleepQueue::SiftUp(int index)
+{
+    Sleeper item = heap[index];
+    int parent;
+
+    while (index > 0) {
+	parent = (index - 1) / 2;
+	if (SleeperCompare(&item, &heap[parent]) >= 0)
+	    break;
+	heap[index] = heap[parent];
+	index = parent;
+    }
+    heap[index] = item;
+}
+
+void
+SleepQueue::SiftDown(int index)
+{
+    Sleeper item = heap[index];
+    int child;
+
+    for (;;) {
+	child = 2 * index + 1;
+	if (child >= numSleeping)
+	    break;
+	if (child + 1 < numSleeping 
+		&& SleeperCompare(&heap[child + 1], &heap[child]) < 0)
+	    child++;
+	if (SleeperCompare(&heap[child], &item) >= 0)
+	    break;
+	heap[index] = heap[child];
+	index = child;
+    }
+    heap[index] = item;
 }
@@ -8,7 +8,16 @@
 //	From this, we provide the ability for a thread to be
 //	woken up after a delay; we also provide time-slicing.
 //
-//	NOTE: this abstraction is not completely implemented.
+//	Sleeping threads are kept in a heap, by when they are to wake
+//	up.  Rather than look at it on every timer interrupt, the alarm
+//	asks for a one-shot interrupt at the earliest wake-up time, so 
+//	threads wake up on the dot, and an idle CPU rolls time forward
+//	to the wake-up without having to stop on the way.
+//
+//	The timer only runs while it has something to do: while a thread
+//	is waiting on the CPU's ready list for the running one to be 
+//	time-sliced.  A thread with the CPU to itself runs without timer
+//	interrupts, and an idle CPU has none to wake up for.
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -22,18 +31,68 @@
 #include "callback.h"
 #include "timer.h"
 
+class Cpu;
+class Thread;
+
+// A thread waiting for the alarm to wake it up.
+class Sleeper {
+  public:
+    int when;			// time to wake up
+    unsigned int order;		// when it went to sleep, relative to 
+				// the others; breaks ties in "when"
+    Thread *thread;
+};
+
+// The threads sleeping on an alarm, as a binary heap with the first
+// to wake up at the top.  It calls itself back, with an interrupt,
+// when that one is due.
+class SleepQueue : public CallBackObj {
+  public:
+    SleepQueue();		// Initialize an empty queue
+    ~SleepQueue();
+
+    void Insert(Thread *thread, int when);
+				// Queue "thread" to be woken up at time
+				// "when"; the caller puts it to sleep
+    int NumSleeping() { return numSleeping; }
+    int NextWakeUp();		// When the first sleeper is due; 
+				// NeverDue if there are none
+
+    void CallBack();		// Wake up every thread that is due
+
+  private:
+    Sleeper *heap;		// the sleepers, earliest at heap[0]
+    int numSleeping;		// number of entries in use in "heap"
+    int maxSleeping;		// size of the "heap" array
+    unsigned int numInserted;	// source of Sleeper::order
+    int armedFor;		// when the interrupt is scheduled for;
+				// NeverDue if it isn't
+
+    void SiftUp(int index);	// Restore the heap order, after
+    void SiftDown(int index);	// heap[index] has been changed
+    void Arm();			// Schedule the interrupt for heap[0]
+};
+
 // The following class defines a software alarm clock. 
 class Alarm : public CallBackObj {
   public:
-    Alarm(bool doRandomYield);	// Initialize the timer, and callback 
-				// to "toCall" every time slice.
-    ~Alarm() { delete timer; }
+    Alarm(bool doRandomYield, Cpu *cpu);
+				// Initialize the timer, and callback 
+				// to "toCall" every time slice of "cpu".
+    ~Alarm() { delete timer; delete sleepers; }
     
-    void WaitUntil(int x);	// suspend execution until time > now + x
-                                // this method is not yet implemented
+    void WaitUntil(int x);	// suspend execution for "x" ticks, 
+				// until time >= now + x
+    void StartSlicing() { timer->Enable(); }
+				// A thread is waiting for the CPU, so
+				// make sure the timer is running
+
+    void SelfTest();		// test sleeping and waking up
 
   private:
     Timer *timer;		// the hardware timer device
+    Cpu *cpu;			// the CPU it time-slices
+    SleepQueue *sleepers;	// threads waiting to be woken up
 
     void CallBack();		// called when the hardware
 				// timer generates an interrupt
@@ -0,0 +1,149 @@
+// cpu.cc
+//	Routines to set up the CPUs of a simulated multiprocessor, and
+//	the idle thread each of them runs when it has nothing else to.
+//
+//	How the CPUs take turns is up to Interrupt::SwitchCpu; which
+//	threads they run is up to the Scheduler.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "cpu.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// IdleLoop
+// 	The idle thread of a CPU.  Run whatever is ready for the CPU --
+//	or for any other CPU, if it has more than it can get to -- and
+//	when there is nothing, wait for another CPU to send some.
+//
+//	The idle thread is never on a ready list: a thread that blocks
+//	with nothing else ready switches to it directly (see
+//	Thread::Sleep).  It runs in IdleMode, so that no interrupt
+//	handler asks it to yield.
+//----------------------------------------------------------------------
+
+static void
+IdleLoop(Cpu *cpu)
+{
+    Interrupt *interrupt = kernel->interrupt;
+    Thread *nextThread;
+
+    (void) interrupt->SetLevel(IntOff);
+    for (;;) {
+	ASSERT(kernel->cpu == cpu && kernel->currentThread == cpu->idleThread);
+	cpu->ipiPending = FALSE;	// looking is all an IPI asks for
+	cpu->sliceUp = FALSE;
+	nextThread = kernel->scheduler->FindNextToRun();
+	if (nextThread != NULL) {
+	    interrupt->setStatus(SystemMode);
+	    kernel->scheduler->Run(nextThread, FALSE);
+				// back when the CPU has nothing to do
+	    interrupt->setStatus(IdleMode);
+	} else {
+	    interrupt->Idle();	// back when another CPU wakes it
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// Cpu::Cpu
+// 	Initialize a CPU, and start its timer.  If there is more than one
+//	CPU, give it an idle thread.
+//
+//	"id" -- which CPU it is
+//	"machine" -- its registers and TLB
+//	"thread" -- the thread it starts out running; NULL if it starts
+//		out idle
+//	"randomSlice" -- if TRUE, time slices are of random lengths
+//----------------------------------------------------------------------
+
+Cpu::Cpu(int id, Machine *machine, Thread *thread, bool randomSlice)
+{
+    this->id = id;
+    this->machine = machine;
+    alarm = new Alarm(randomSlice, this);
+    idleThread = NULL;
+    if (kernel->numCpus > 1) {
+	char *name = new char[16];
+
+	sprintf(name, "idle %d", id);
+	idleThread = new Thread(name, -1);
+	idleThread->StackAllocate((VoidFunctionPtr) IdleLoop, (void *) this);
+    }
+
+    ticks = kernel->stats->totalTicks;
+    idleTicks = 0;
+    ipiPending = FALSE;
+    sliceUp = FALSE;
+    level = IntOff;
+    tlbOwner = NULL;
+    if (thread != NULL) {
+	this->thread = thread;
+	idle = FALSE;
+	status = SystemMode;
+    } else {
+	ASSERT(idleThread != NULL);
+	this->thread = idleThread;
+	idle = TRUE;
+	status = IdleMode;
+    }
+}
+
+//----------------------------------------------------------------------
+// Cpu::~Cpu
+// 	Nachos is halting.  De-allocate the CPU.
+//----------------------------------------------------------------------
+
+Cpu::~Cpu()
+{
+    delete alarm;
+    delete machine;
+    if (idleThread != NULL && idleThread != kernel->currentThread)
+	delete idleThread;
+}
+
+//----------------------------------------------------------------------
+// Cpu::CallBack
+// 	Another CPU has interrupted this one, because a thread it might
+//	rather run has been made ready, or because its time slice is up.
+//	Called with interrupts disabled, as this CPU takes its turn.
+//
+//	Like a timer interrupt, this just asks for a context switch once
+//	the handler returns -- a preemption, unless it is the time slice
+//	that is up.  An idle CPU looks for something to run anyway.
+//----------------------------------------------------------------------
+
+void
+Cpu::CallBack()
+{
+    Interrupt *interrupt = kernel->interrupt;
+    bool preempting = !sliceUp;
+
+    sliceUp = FALSE;
+    if (interrupt->getStatus() != IdleMode 
+			&& kernel->scheduler->ShouldPreempt())
+	interrupt->YieldOnReturn(preempting);
+}
+
+//----------------------------------------------------------------------
+// Cpu::Print
+// 	Print how much of the simulated time so far the CPU has spent
+//	running threads, and how much waiting for one.
+//----------------------------------------------------------------------
+
+void
+Cpu::Print()
+{
+    int now = (this == kernel->cpu) ? kernel->stats->totalTicks : ticks;
+    int waited = idleTicks;
+
+    if (idle) {				// still waiting
+	waited += kernel->stats->totalTicks - ticks;
+	now = kernel->stats->totalTicks;
+    }
+    cout << "CPU " << id << ": busy " << now - waited << " ticks, idle "
+	 << waited << " ticks\n";
+}
@@ -0,0 +1,80 @@
+// cpu.h
+//	Data structures for simulating a shared-memory multiprocessor.
+//
+//	Each CPU has its own registers and TLB (a Machine), its own timer
+//	(an Alarm), its own ready list (see Scheduler), and a thread it
+//	is running.  Main memory, the devices and the kernel are shared.
+//
+//	Only one CPU is simulated at a time.  After every tick of
+//	simulated time, Interrupt::SwitchCpu moves on to whichever CPU
+//	has got least far, so CPUs running user code take turns one
+//	instruction at a time, and a run with the same flags always
+//	interleaves the same way.  While a CPU is being simulated,
+//	kernel->cpu, kernel->machine, kernel->alarm and
+//	kernel->currentThread are its own; its Cpu holds them, and its
+//	interrupt state, while another CPU takes its turn.
+//
+//	Kernel code only gives up the CPU where a uniprocessor could
+//	be preempted -- when simulated time advances -- so code that is
+//	safe with random time slicing (-rs) is safe here too.
+//
+//	A CPU with nothing to run switches to its idle thread, which
+//	takes no turns until another CPU gives it something to do, and
+//	sends it an inter-processor interrupt.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef CPU_H
+#define CPU_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "callback.h"
+#include "interrupt.h"
+
+class Machine;
+class Alarm;
+class Thread;
+class AddrSpace;
+
+const int MaxCpus = 8;		// the most CPUs -smp can ask for
+
+class Cpu : public CallBackObj {
+  public:
+    Cpu(int id, Machine *machine, Thread *thread, bool randomSlice);
+				// Initialize CPU "id", with registers
+				// and a TLB in "machine", running
+				// "thread" (or idle, if NULL)
+    ~Cpu();			// De-allocate the CPU
+
+    void CallBack();		// Handle an inter-processor interrupt:
+				// reschedule, unless idle
+    void Print();		// Print how busy the CPU has been
+
+    int id;			// which CPU this is, from 0
+    Machine *machine;		// its registers and TLB
+    Alarm *alarm;		// its timer, for time slicing
+    Thread *thread;		// the thread it is running
+    Thread *idleThread;		// runs when nothing else is ready;
+				// NULL if there is only one CPU
+
+    int ticks;			// its clock: how far it has got in
+				// simulated time
+    bool idle;			// waiting for work?  If so, it takes
+				// no turns, and its clock stands still
+    int idleTicks;		// simulated time spent waiting
+    bool ipiPending;		// interrupted by another CPU, and not
+				// yet taken its turn since
+    bool sliceUp;		// ... by its own timer, passed on to
+				// it because the time slice is up
+
+    MachineStatus status;	// its interrupt state, while another
+    IntStatus level;		// CPU is being simulated
+
+    AddrSpace *tlbOwner;	// address space whose page table
+				// entries are loaded in its TLB
+};
+
+#endif // CPU_H
@@ -0,0 +1,262 @@
+// hostthread.cc
+//	Routines to run Nachos threads on host threads of their own,
+//	passing the simulation lock between them on a context switch.
+//
+//	Only the thread the lock has been passed to goes on; every other
+//	one waits on its own condition variable to be passed it, except
+//	one doing host work, which takes the lock back when it is done.
+//	A thread switched to while it is still at its host work makes
+//	the simulation wait for it there, at the same simulated moment
+//	however long the work takes, so runs are as repeatable as ever.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "hostthread.h"
+#include "main.h"
+#include <limits.h>
+#include <string.h>
+
+// Held by whichever host thread is running the simulation.
+static pthread_mutex_t simulationLock = PTHREAD_MUTEX_INITIALIZER;
+
+// The one it has last been passed to.
+static HostThread *running = NULL;
+
+//----------------------------------------------------------------------
+// HostThread::HostThread
+// 	Initialize the host thread Nachos started on, for "main", which
+//	is running the simulation, so takes the lock.
+//----------------------------------------------------------------------
+
+HostThread::HostThread()
+{
+    id = pthread_self();
+    started = TRUE;
+    stackSize = 0;			// the host gave it one already
+    pthread_cond_init(&turn, NULL);
+    func = NULL;
+    arg = NULL;
+    work = NULL;
+    workArg = NULL;
+
+    ASSERT(running == NULL);
+    pthread_mutex_lock(&simulationLock);
+    running = this;
+}
+
+//----------------------------------------------------------------------
+// HostThread::HostThread
+// 	Initialize a host thread for a forked thread.  It isn't created
+//	until the thread is first switched to.
+//
+//	"func" is the procedure for it to run.
+//	"arg" is the argument to pass it.
+//	"stackBytes" is how big a stack it needs; the Thread's own
+//		stack size, as SWITCH would have given it.
+//----------------------------------------------------------------------
+
+HostThread::HostThread(VoidFunctionPtr func, void *arg, int stackBytes)
+{
+    started = FALSE;
+    stackSize = (stackBytes < PTHREAD_STACK_MIN) ? PTHREAD_STACK_MIN
+						: stackBytes;
+    pthread_cond_init(&turn, NULL);
+    this->func = func;
+    this->arg = arg;
+    work = NULL;
+    workArg = NULL;
+}
+
+//----------------------------------------------------------------------
+// HostThread::~HostThread
+// 	De-allocate a host thread.  Called once the Thread has finished,
+//	by then its host thread has let go of the lock and is exiting.
+//----------------------------------------------------------------------
+
+HostThread::~HostThread()
+{
+    ASSERT(running != this);
+    pthread_cond_destroy(&turn);
+}
+
+//----------------------------------------------------------------------
+// HostThread::SetWork
+// 	Have (*func)(arg) run once the thread is switched away from,
+//	after it has passed the lock on.  Called by Thread::RunOnHost.
+//----------------------------------------------------------------------
+
+void
+HostThread::SetWork(VoidFunctionPtr func, void *arg)
+{
+    ASSERT(running == this && work == NULL);
+    work = func;
+    workArg = arg;
+}
+
+//----------------------------------------------------------------------
+// HostThread::WaitTurn
+// 	Wait, holding the lock, until it has been passed to us.
+//----------------------------------------------------------------------
+
+void
+HostThread::WaitTurn()
+{
+    while (running != this)
+	pthread_cond_wait(&turn, &simulationLock);
+}
+
+//----------------------------------------------------------------------
+// HostThread::Root
+// 	Where the host thread of a forked thread starts, when it is first
+//	switched to: what ThreadRoot does on a stack of our own making.
+//----------------------------------------------------------------------
+
+void *
+HostThread::Root(void *host)
+{
+    HostThread *self = (HostThread *) host;
+
+    pthread_mutex_lock(&simulationLock);
+    self->WaitTurn();
+    kernel->currentThread->Begin();
+    (*self->func)(self->arg);
+    kernel->currentThread->Finish();
+    ASSERTNOTREACHED();
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// HostThread::Switch
+// 	Stop running oldThread and start running nextThread, by passing
+//	the lock from one to the other; starting nextThread's host
+//	thread, the first time.  Called wherever SWITCH would be.
+//
+//	Host threads get no more stack than the Thread asked for:
+//	the default is megabytes, and with -m32 a few hundred threads
+//	of that size use up the address space.  If one can't be
+//	created anyway, there is nothing to switch to, so we stop.
+//
+//	Returns once oldThread has been passed the lock back -- unless
+//	it is finishing, in which case its host thread exits, and the
+//	next thread deletes the Thread as usual.
+//
+//	"finishing" is set if oldThread is done.
+//----------------------------------------------------------------------
+
+void
+HostThread::Switch(Thread *oldThread, Thread *nextThread, bool finishing)
+{
+    HostThread *old = oldThread->host;
+    HostThread *next = nextThread->host;
+    VoidFunctionPtr work = old->work;
+    void *workArg = old->workArg;
+
+    ASSERT(running == old);
+    running = next;
+    if (next->started) {
+	pthread_cond_signal(&next->turn);
+    } else {
+	pthread_attr_t attr;
+	int error;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	pthread_attr_setstacksize(&attr, next->stackSize);
+	error = pthread_create(&next->id, &attr, Root, (void *) next);
+	pthread_attr_destroy(&attr);
+	if (error != 0) {
+	    cerr << "Can't create a host thread for " << nextThread->getName()
+		<< ": " << strerror(error) << "\n";
+	    Exit(1);
+	}
+	next->started = TRUE;
+    }
+
+    if (finishing) {
+	pthread_mutex_unlock(&simulationLock);
+	pthread_exit(NULL);		// the Thread is deleted without us
+    }
+    if (work != NULL) {
+	old->work = NULL;
+	pthread_mutex_unlock(&simulationLock);
+	(*work)(workArg);		// meanwhile, the simulation goes on
+	pthread_mutex_lock(&simulationLock);
+    }
+    old->WaitTurn();
+}
+
+// What the threads the benchmark forks work on.
+static unsigned char *benchData;
+static int benchSize;
+static int benchRounds;
+
+//----------------------------------------------------------------------
+// Checksum
+// 	Host work for the benchmark: checksum its data into *sum.
+//----------------------------------------------------------------------
+
+static void
+Checksum(unsigned int *sum)
+{
+    unsigned int a = 1, b = 0;
+
+    for (int i = 0; i < benchSize; i++) {
+	a = (a + benchData[i]) % 65521;
+	b = (b + a) % 65521;
+    }
+    *sum = (b << 16) | a;
+}
+
+//----------------------------------------------------------------------
+// ChecksumThread
+// 	The body of each thread the benchmark forks: checksum its data
+//	over and over, as host work.
+//----------------------------------------------------------------------
+
+static void
+ChecksumThread(void *arg)
+{
+    unsigned int sum, first = 0;
+
+    for (int r = 0; r < benchRounds; r++) {
+	kernel->currentThread->RunOnHost((VoidFunctionPtr) Checksum,
+							(void *) &sum);
+	if (r == 0)
+	    first = sum;
+	ASSERT(sum == first);
+    }
+}
+
+//----------------------------------------------------------------------
+// HostThread::Benchmark
+// 	Time "numThreads" kernel threads each checksumming "size" bytes,
+//	"numRounds" times, with Thread::RunOnHost.  With -hostthreads,
+//	the checksums can run at once, on as many host CPUs as there
+//	are; otherwise, they take turns.  Either way, they take the same
+//	simulated time.
+//----------------------------------------------------------------------
+
+void
+HostThread::Benchmark(int numThreads, int numRounds, int size)
+{
+    int startTicks = kernel->stats->totalTicks;
+    double start;
+
+    benchData = new unsigned char[size];
+    for (int i = 0; i < size; i++)
+	benchData[i] = (unsigned char) (i * 7 + 3);
+    benchSize = size;
+    benchRounds = numRounds;
+
+    start = HostTime();
+    Thread::ForkAndJoin("checksum", numThreads, ChecksumThread, NULL);
+    cout << "Host work, " << numThreads << " threads checksumming " << size
+	<< " bytes " << numRounds << " times: " << HostTime() - start
+	<< " s, " << kernel->stats->totalTicks - startTicks << " ticks, "
+	<< (kernel->hostThreads ? "on host threads" : "on one host thread")
+	<< "\n";
+    delete [] benchData;
+}
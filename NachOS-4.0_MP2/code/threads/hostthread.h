@@ -0,0 +1,62 @@
+// hostthread.h
+//	Data structures for running each Nachos thread on a host thread
+//	of its own (-hostthreads), rather than switching one host thread
+//	between their stacks with SWITCH.
+//
+//	The simulation still runs one thread at a time: the one holding
+//	the simulation lock, which a context switch passes from the old
+//	thread to the new one.  So the simulated machine behaves, and
+//	simulated time goes by, just as it does with SWITCH.  What is
+//	different is that a thread can let go of the lock for work that
+//	touches nothing simulated (see Thread::RunOnHost), and get on
+//	with it on another host CPU while the simulation carries on.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef HOSTTHREAD_H
+#define HOSTTHREAD_H
+
+#include "copyright.h"
+#include "utility.h"
+#include <pthread.h>
+
+class Thread;
+
+class HostThread {
+  public:
+    HostThread();			// the host thread Nachos started on,
+					// for "main"; takes the lock
+    HostThread(VoidFunctionPtr func, void *arg, int stackBytes);
+					// a host thread to run (*func)(arg),
+					// on a stack of "stackBytes", started
+					// the first time it is switched to
+    ~HostThread();
+
+    void SetWork(VoidFunctionPtr func, void *arg);
+					// have (*func)(arg) run outside the
+					// lock, once switched away from
+
+    static void Switch(Thread *oldThread, Thread *nextThread,
+							bool finishing);
+					// pass the lock from oldThread to
+					// nextThread; instead of SWITCH
+    static void Benchmark(int numThreads, int numRounds, int size);
+					// time threads doing host work
+
+  private:
+    pthread_t id;
+    bool started;			// has the host thread been created?
+    int stackSize;			// in bytes
+    pthread_cond_t turn;		// signalled when passed the lock
+    VoidFunctionPtr func;		// what it runs, once started
+    void *arg;
+    VoidFunctionPtr work;		// host work to do outside the lock;
+    void *workArg;			// NULL if none
+
+    void WaitTurn();			// wait until passed the lock
+    static void *Root(void *host);	// where the host thread starts
+};
+
+#endif // HOSTTHREAD_H
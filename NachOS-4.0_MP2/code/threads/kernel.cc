@@ -17,6 +17,8 @@
 #include "synchdisk.h"
 #include "post.h"
 #include "synchconsole.h"
+#include "profile.h"
+#include "hostthread.h"
 
 //----------------------------------------------------------------------
 // Kernel::Kernel
@@ -29,6 +31,26 @@ Kernel::Kernel(int argc, char **argv)
 
     randomSlice = FALSE; 
     debugUserProg = FALSE;
+    numCpus = 1;
+    schedulerPolicy = SchedRoundRobin;
+    priorityInheritance = TRUE;
+    hostThreads = FALSE;
+    threadPoolLimit = DefaultPoolLimit;
+    threadPool = NULL;
+    threadNum = 0;
+    execfileNum = 0;
+    for (int i = 0; i < MaxUserPrograms; i++)
+	exited[i] = NULL;
+#ifdef USE_TLB
+    tlbSize = TLBSize;
+#else
+    tlbSize = 0;
+#endif
+    tlbWays = 0;
+    tlbPolicy = TLBFifo;
+    demandPaging = FALSE;
+    vmPolicy = ReplaceClock;
+    profileInterval = 0;
     consoleIn = NULL;          // default is stdin
     consoleOut = NULL;         // default is stdout
 #ifndef FILESYS_STUB
@@ -47,7 +69,17 @@ Kernel::Kernel(int argc, char **argv)
         } else if (strcmp(argv[i], "-s") == 0) {
             debugUserProg = TRUE;
 		} else if (strcmp(argv[i], "-e") == 0) {
+	    	ASSERT(execfileNum + 1 < MaxUserPrograms);
+        	execfile[++execfileNum]= argv[++i];
+        	execPriority[execfileNum] = MaxPriority;
+			cout << execfile[execfileNum] << "\n";
+		} else if (strcmp(argv[i], "-ep") == 0) {
+	    	ASSERT(i + 2 < argc);	// program, then its priority
+	    	ASSERT(execfileNum + 1 < MaxUserPrograms);
         	execfile[++execfileNum]= argv[++i];
+        	execPriority[execfileNum] = atoi(argv[++i]);
+        	ASSERT(execPriority[execfileNum] >= 0 
+				&& execPriority[execfileNum] <= MaxPriority);
 			cout << execfile[execfileNum] << "\n";
 		} else if (strcmp(argv[i], "-ci") == 0) {
 	    	ASSERT(i + 1 < argc);
@@ -69,6 +101,73 @@ Kernel::Kernel(int argc, char **argv)
             ASSERT(i + 1 < argc);   // next argument is int
             hostName = atoi(argv[i + 1]);
             i++;
+        } else if (strcmp(argv[i], "-tlb") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is number of entries
+            tlbSize = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-tlbways") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is entries per set
+            tlbWays = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-tlbpolicy") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is fifo, lru or random
+            if (strcmp(argv[i + 1], "lru") == 0) {
+                tlbPolicy = TLBLru;
+            } else if (strcmp(argv[i + 1], "random") == 0) {
+                tlbPolicy = TLBRandom;
+            } else {
+                ASSERT(strcmp(argv[i + 1], "fifo") == 0);
+                tlbPolicy = TLBFifo;
+            }
+            i++;
+        } else if (strcmp(argv[i], "-smp") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is number of CPUs
+            numCpus = atoi(argv[i + 1]);
+            ASSERT(numCpus >= 1 && numCpus <= MaxCpus);
+            i++;
+        } else if (strcmp(argv[i], "-sched") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is rr, mlfq, prio or srtf
+            if (strcmp(argv[i + 1], "mlfq") == 0) {
+                schedulerPolicy = SchedMultiLevel;
+            } else if (strcmp(argv[i + 1], "prio") == 0) {
+                schedulerPolicy = SchedPriority;
+            } else if (strcmp(argv[i + 1], "srtf") == 0) {
+                schedulerPolicy = SchedShortestFirst;
+            } else {
+                ASSERT(strcmp(argv[i + 1], "rr") == 0);
+                schedulerPolicy = SchedRoundRobin;
+            }
+            i++;
+        } else if (strcmp(argv[i], "-noinherit") == 0) {
+            priorityInheritance = FALSE;
+        } else if (strcmp(argv[i], "-hostthreads") == 0) {
+            hostThreads = TRUE;
+        } else if (strcmp(argv[i], "-tpool") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is how much to keep
+            threadPoolLimit = atoi(argv[i + 1]);
+            ASSERT(threadPoolLimit >= 0);
+            i++;
+        } else if (strcmp(argv[i], "-prof") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is the sample interval
+            profileInterval = atoi(argv[i + 1]);
+            ASSERT(profileInterval > 0);
+            i++;
+#ifdef FILESYS_STUB
+        } else if (strcmp(argv[i], "-vm") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is fifo, clock, lru or ws
+            demandPaging = TRUE;
+            if (strcmp(argv[i + 1], "fifo") == 0) {
+                vmPolicy = ReplaceFIFO;
+            } else if (strcmp(argv[i + 1], "lru") == 0) {
+                vmPolicy = ReplaceLRU;
+            } else if (strcmp(argv[i + 1], "ws") == 0) {
+                vmPolicy = ReplaceWorkingSet;
+            } else {
+                ASSERT(strcmp(argv[i + 1], "clock") == 0);
+                vmPolicy = ReplaceClock;
+            }
+            i++;
+#endif
         } else if (strcmp(argv[i], "-u") == 0) {
             cout << "Partial usage: nachos [-rs randomSeed]\n";
 	   		cout << "Partial usage: nachos [-s]\n";
@@ -77,8 +176,19 @@ Kernel::Kernel(int argc, char **argv)
 	    	cout << "Partial usage: nachos [-nf]\n";
 #endif
             cout << "Partial usage: nachos [-n #] [-m #]\n";
+            cout << "Partial usage: nachos [-tlb #] [-tlbways #] [-tlbpolicy fifo|lru|random]\n";
+            cout << "Partial usage: nachos [-ep file priority]\n";
+            cout << "Partial usage: nachos [-smp #] [-sched rr|mlfq|prio|srtf] [-prof #]\n";
+            cout << "Partial usage: nachos [-noinherit]\n";
+            cout << "Partial usage: nachos [-tpool #] [-hostthreads]\n";
+#ifdef FILESYS_STUB
+            cout << "Partial usage: nachos [-vm fifo|clock|lru|ws]\n";
+#endif
 		}
     }
+    if (schedulerPolicy != SchedPriority)
+	priorityInheritance = FALSE;	// priorities don't decide who runs,
+					// or change by themselves
 }
 
 //----------------------------------------------------------------------
@@ -95,21 +205,37 @@ Kernel::Initialize()
     // But if it ever tries to give up the CPU, we better have a Thread
     // object to save its state. 
 
-    availFrameTable = new int[NumPhysPages];
-    for (int i = 0; i < NumPhysPages; i++)
-        availFrameTable[i] = 0;
+    frameAllocator = new FrameAllocator(NumPhysPages);
+    threadPool = new ThreadPool(threadPoolLimit);
 
     currentThread = new Thread("main", threadNum++);		
     currentThread->setStatus(RUNNING);
+    if (hostThreads)			// we run on the one we started on
+	currentThread->host = new HostThread();
 
     stats = new Statistics();		// collect statistics
+    debug->SetClock(&stats->totalTicks);
     interrupt = new Interrupt;		// start up interrupt handling
-    scheduler = new Scheduler();	// initialize the ready queue
-    alarm = new Alarm(randomSlice);	// start up time slicing
-    machine = new Machine(debugUserProg);
+    scheduler = new Scheduler(schedulerPolicy, numCpus);
+					// initialize the ready queue
+    for (int i = 0; i < numCpus; i++) {	// start up the CPUs, and their
+					// time slicing
+	machine = (i == 0) ? new Machine(debugUserProg) : new Machine(machine);
+	if (tlbSize > 0)
+	    machine->ConfigureTLB(tlbSize, tlbWays, tlbPolicy);
+	cpus[i] = new Cpu(i, machine, (i == 0) ? currentThread : NULL,
+								randomSlice);
+    }
+    cpu = cpus[0];			// we are running on the first
+    machine = cpu->machine;
+    alarm = cpu->alarm;
     synchConsoleIn = new SynchConsoleInput(consoleIn); // input from stdin
     synchConsoleOut = new SynchConsoleOutput(consoleOut); // output to stdout
     synchDisk = new SynchDisk();    //
+    if (demandPaging)
+	coreMap = new CoreMap(vmPolicy);	// swap lives on synchDisk
+    else
+	coreMap = NULL;
 #ifdef FILESYS_STUB
     fileSystem = new FileSystem();
 #else
@@ -128,17 +254,24 @@ Kernel::Initialize()
 
 Kernel::~Kernel()
 {
+    Profile::ReportAll();
     delete stats;
     delete interrupt;
     delete scheduler;
-    delete alarm;
-    delete machine;
+    for (int i = numCpus - 1; i >= 0; i--)
+	delete cpus[i];			// with their alarms and machines
+    delete threadPool;
     delete synchConsoleIn;
     delete synchConsoleOut;
+    delete coreMap;
+    delete frameAllocator;
     delete synchDisk;
     delete fileSystem;
     delete postOfficeIn;
     delete postOfficeOut;
+    for (int i = 0; i < MaxUserPrograms; i++)
+	delete exited[i];
+    debug->SaveTrace();			// if recording trace events
     
     Exit(0);
 }
@@ -151,6 +284,7 @@ Kernel::~Kernel()
 void
 Kernel::ThreadSelfTest() {
    Semaphore *semaphore;
+   Lock *lock;
    SynchList<int> *synchList;
    
    LibSelfTest();		// test library routines
@@ -168,6 +302,13 @@ Kernel::ThreadSelfTest() {
    synchList->SelfTest(9);
    delete synchList;
 
+   lock = new Lock("test");	// test priority inheritance
+   lock->SelfTest();
+   delete lock;
+
+   alarm->SelfTest();		// test sleeping threads
+   interrupt->SelfTest();	// test the pending interrupt queue
+   frameAllocator->SelfTest();	// test physical frame allocation
 }
 
 //----------------------------------------------------------------------
@@ -252,9 +393,38 @@ Kernel::NetworkTest() {
     // Then we're done!
 }
 
+//----------------------------------------------------------------------
+// Kernel::Benchmark
+//      Measure how fast some of the data structures the simulation
+//	leans on are, by running them on synthetic loads.
+//----------------------------------------------------------------------
+
+void
+Kernel::Benchmark() {
+    SynchList<int> *synchList;
+
+    interrupt->Benchmark(4, 1000000);	// console, disk, timer, network
+    interrupt->Benchmark(64, 1000000);
+    interrupt->Benchmark(1024, 100000);
+    scheduler->Benchmark(1000, 10);
+    scheduler->Benchmark(4000, 2);
+    threadPool->Benchmark(20000, 1);
+    threadPool->Benchmark(20000, 20);
+    threadPool->Benchmark(20000, 100);
+    HostThread::Benchmark(4, 20, 1 << 20);
+
+    synchList = new SynchList<int>;
+    synchList->Benchmark(2, 1, 100000);
+    synchList->Benchmark(8, 1, 20000);
+    synchList->Benchmark(64, 1, 2000);
+    synchList->Benchmark(64, 16, 2000);
+    delete synchList;
+}
+
 void ForkExecute(Thread *t)
 {
 	if ( !t->space->Load(t->getName()) ) {
+    	kernel->ProgramExit(-1);
     	return;             // executable not found
     }
 	
@@ -262,20 +432,38 @@ void ForkExecute(Thread *t)
 
 }
 
+//----------------------------------------------------------------------
+// ForkReturn
+// 	Where a thread created by Kernel::Fork starts: pick up the user
+//	registers the parent had at the Fork, and go back to user mode.
+//----------------------------------------------------------------------
+
+void ForkReturn(Thread *t)
+{
+    t->RestoreUserState();
+    t->space->RestoreState();
+    kernel->machine->Run();
+    ASSERTNOTREACHED();
+}
+
 void Kernel::ExecAll()
 {
 	for (int i=1;i<=execfileNum;i++) {
-		int a = Exec(execfile[i]);
+		int a = Exec(execfile[i], execPriority[i]);
 	}
 	currentThread->Finish();
     //Kernel::Exec();	
 }
 
 
-int Kernel::Exec(char* name)
+int Kernel::Exec(char* name, int priority)
 {
+	if (threadNum >= MaxUserPrograms)
+		return -1;
 	t[threadNum] = new Thread(name, threadNum);
+	t[threadNum]->priority = priority;
 	t[threadNum]->space = new AddrSpace();
+	exited[threadNum] = new Semaphore("exited", 0);
 	t[threadNum]->Fork((VoidFunctionPtr) &ForkExecute, (void *)t[threadNum]);
 	threadNum++;
 
@@ -306,15 +494,67 @@ int Kernel::Exec(char* name)
 //    Kernel::Run();
 //  cout << "after ThreadedKernel:Run();" << endl;  // unreachable
 }
-int Kernel::allocateFrame()
+
+//----------------------------------------------------------------------
+// Kernel::Fork
+// 	Start a copy of the running user program, sharing its memory
+//	copy-on-write.  The copy carries on from the same place, with
+//	Fork returning 0 to it.  Must be called with the user program
+//	counter already past the syscall.
+//
+//	Returns the id of the copy, or -1 if there are too many programs.
+//----------------------------------------------------------------------
+
+int Kernel::Fork()
 {
-    for (int frame = 0; frame < NumPhysPages; frame++)
-    {
-        if (!availFrameTable[frame])
-        {
-            availFrameTable[frame] = 1;
-            return frame;
-        }
-    }
-    return -1;
+	Thread *child;
+	int id = threadNum;
+
+	if (id >= MaxUserPrograms)
+		return -1;
+	child = new Thread(currentThread->getName(), id);
+	child->priority = currentThread->priority;
+	child->space = new AddrSpace(currentThread->space);
+	exited[id] = new Semaphore("exited", 0);
+	t[id] = child;
+	threadNum++;
+
+	machine->WriteRegister(2, 0);	// what Fork returns to the copy
+	child->SaveUserState();
+	child->Fork((VoidFunctionPtr) &ForkReturn, (void *)child);
+	return id;
+}
+
+//----------------------------------------------------------------------
+// Kernel::Join
+// 	Wait for user program "id" to exit, and return its exit status;
+//	-1 if there is no such program, or it is the one asking, which
+//	would wait forever.  A program can be joined any number of times.
+//----------------------------------------------------------------------
+
+int Kernel::Join(int id)
+{
+	if (id <= 0 || id >= threadNum || exited[id] == NULL)
+		return -1;
+	if (id == currentThread->getID())
+		return -1;
+	exited[id]->P();
+	exited[id]->V();		// let anyone else waiting go too
+	return exitStatus[id];
+}
+
+//----------------------------------------------------------------------
+// Kernel::ProgramExit
+// 	Record the exit status of the running user program, and wake up
+//	whoever is waiting in Join for it.
+//----------------------------------------------------------------------
+
+void Kernel::ProgramExit(int status)
+{
+	int id = currentThread->getID();
+
+	if (id <= 0 || id >= threadNum || exited[id] == NULL)
+		return;
+	exitStatus[id] = status;
+	exited[id]->V();
 }
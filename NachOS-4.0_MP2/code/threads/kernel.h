@@ -18,15 +18,21 @@
 #include "alarm.h"
 #include "filesys.h"
 #include "machine.h"
+#include "coremap.h"
+#include "cpu.h"
+#include "threadpool.h"
 
 class PostOfficeInput;
 class PostOfficeOutput;
 class SynchConsoleInput;
 class SynchConsoleOutput;
 class SynchDisk;
+class Semaphore;
 
 typedef int OpenFileId;
 
+const int MaxUserPrograms = 32;	// programs run, and forked, in one go
+
 class Kernel {
   public:
     Kernel(int argc, char **argv);
@@ -37,11 +43,15 @@ class Kernel {
 				// from constructor because 
 				// refers to "kernel" as a global
     void ExecAll();
-    int Exec(char* name);
+    int Exec(char* name, int priority);
+    int Fork();			// copy the running user program
+    int Join(int id);		// wait for user program "id" to exit
+    void ProgramExit(int status);	// the running user program is done
     void ThreadSelfTest();	// self test of threads and synchronization
 	
     void ConsoleTest();         // interactive console self test
     void NetworkTest();         // interactive 2-machine network test
+    void Benchmark();		// time kernel and machine data structures
     Thread* getThread(int threadID){return t[threadID];}    
 
 
@@ -57,11 +67,17 @@ class Kernel {
 // they're global variables used everywhere.
 
     Thread *currentThread;	// the thread holding the CPU
+    ThreadPool *threadPool;	// memory of finished threads, for reuse
     Scheduler *scheduler;	// the ready list
     Interrupt *interrupt;	// interrupt status
     Statistics *stats;		// performance metrics
     Alarm *alarm;		// the software alarm clock    
     Machine *machine;           // the simulated CPU
+
+    int numCpus;		// CPUs sharing memory (see cpu.h)
+    Cpu *cpus[MaxCpus];
+    Cpu *cpu;			// the one being simulated; the thread,
+				// alarm and machine above are its own
     SynchConsoleInput *synchConsoleIn;
     SynchConsoleOutput *synchConsoleOut;
     SynchDisk *synchDisk;
@@ -71,16 +87,34 @@ class Kernel {
 
     int hostName;               // machine identifier
 
-    int allocateFrame();
-    int *availFrameTable;
+    FrameAllocator *frameAllocator;	// free and used physical frames
+    CoreMap *coreMap;		// frames and swap for demand paging;
+				// NULL if programs are loaded whole
+    int profileInterval;	// user ticks between profile samples;
+				// 0 if programs aren't profiled
+    bool priorityInheritance;	// do lock holders run at the priority of
+				// threads waiting for them?  Only with
+				// the priority scheduler
+    bool hostThreads;		// does each thread run on a host thread
+				// of its own (see hostthread.h)?
   private:
 
-	Thread* t[10];
-	char*   execfile[10];
+	Thread* t[MaxUserPrograms];
+	int exitStatus[MaxUserPrograms];	// what each program exited with
+	Semaphore *exited[MaxUserPrograms];	// signalled once it has
+	char*   execfile[MaxUserPrograms];
+	int execPriority[MaxUserPrograms];	// what each starts out with
 	int execfileNum;
 	int threadNum;
     bool randomSlice;		// enable pseudo-random time slicing
     bool debugUserProg;         // single step user program
+    int tlbSize;		// TLB entries; 0 to use page tables
+    int tlbWays;		// TLB associativity; 0 for full
+    TLBPolicy tlbPolicy;	// TLB replacement policy
+    bool demandPaging;		// load pages as they are touched
+    ReplacementPolicy vmPolicy;	// page replacement policy
+    SchedulerPolicy schedulerPolicy;	// how threads are chosen to run
+    int threadPoolLimit;	// stacks and Threads the pool keeps
     double reliability;         // likelihood messages are dropped
     char *consoleIn;            // file to read console input from
     char *consoleOut;           // file to send console output to
@@ -2,14 +2,18 @@
 //	Driver code to initialize, selftest, and run the 
 //	operating system kernel.  
 //
-// Usage: nachos -d <debugflags> -rs <random seed #>
+// Usage: nachos -d <debugflags> -dr <trace file> -dp <trace file>
+//              -rs <random seed #>
 //              -s -x <nachos file> -ci <consoleIn> -co <consoleOut>
 //              -f -cp <unix file> <nachos file>
 //              -p <nachos file> -r <nachos file> -l -D
 //              -n <network reliability> -m <machine id>
-//              -z -K -C -N
+//              -z -K -C -N -B
 //
 //    -d causes certain debugging messages to be printed (see debug.h)
+//    -dr records the per-instruction ones compactly instead, and saves
+//	the latest of them in a file when Nachos exits
+//    -dp prints a trace file saved by -dr, and exits
 //    -rs causes Yield to occur at random (but repeatable) spots
 //    -z prints the copyright message
 //    -s causes user programs to be executed in single-step mode
@@ -21,6 +25,7 @@
 //    -K run a simple self test of kernel threads and synchronization
 //    -C run an interactive console test
 //    -N run a two-machine network test (see Kernel::NetworkTest)
+//    -B run benchmarks of kernel data structures (see Kernel::Benchmark)
 //
 //    Filesystem-related flags:
 //    -f forces the Nachos disk to be formatted
@@ -168,10 +173,12 @@ main(int argc, char **argv)
 {
     int i;
     char *debugArg = "";
+    char *traceFile = NULL;		// where -dr saves trace events
     char *userProgName = NULL;        // default is not to execute a user prog
     bool threadTestFlag = false;
     bool consoleTestFlag = false;
     bool networkTestFlag = false;
+    bool benchmarkFlag = false;
 #ifndef FILESYS_STUB
     char *copyUnixFileName = NULL;    // UNIX file to be copied into Nachos
     char *copyNachosFileName = NULL;  // name of copied file in Nachos
@@ -190,6 +197,15 @@ main(int argc, char **argv)
             debugArg = argv[i + 1];
 	    i++;
 	}
+	else if (strcmp(argv[i], "-dr") == 0) {
+	    ASSERT(i + 1 < argc);
+	    traceFile = argv[i + 1];
+	    i++;
+	}
+	else if (strcmp(argv[i], "-dp") == 0) {
+	    ASSERT(i + 1 < argc);
+	    return Debug::PrintTrace(argv[i + 1]) ? 0 : 1;
+	}
 	else if (strcmp(argv[i], "-z") == 0) {
             cout << copyright << "\n";
 	}
@@ -207,6 +223,9 @@ main(int argc, char **argv)
 	else if (strcmp(argv[i], "-N") == 0) {
 	    networkTestFlag = TRUE;
 	}
+	else if (strcmp(argv[i], "-B") == 0) {
+	    benchmarkFlag = TRUE;
+	}
 #ifndef FILESYS_STUB
 	else if (strcmp(argv[i], "-cp") == 0) {
 	    ASSERT(i + 2 < argc);
@@ -233,8 +252,9 @@ main(int argc, char **argv)
 #endif //FILESYS_STUB
 	else if (strcmp(argv[i], "-u") == 0) {
             cout << "Partial usage: nachos [-z -d debugFlags]\n";
+            cout << "Partial usage: nachos [-dr traceFile] [-dp traceFile]\n";
             cout << "Partial usage: nachos [-x programName]\n";
-	    cout << "Partial usage: nachos [-K] [-C] [-N]\n";
+	    cout << "Partial usage: nachos [-K] [-C] [-N] [-B]\n";
 #ifndef FILESYS_STUB
             cout << "Partial usage: nachos [-cp UnixFile NachosFile]\n";
             cout << "Partial usage: nachos [-p fileName] [-r fileName]\n";
@@ -244,6 +264,8 @@ main(int argc, char **argv)
 
     }
     debug = new Debug(debugArg);
+    if (traceFile != NULL)
+	debug->RecordTo(traceFile);
     
     DEBUG(dbgThread, "Entering main");
 
@@ -264,6 +286,9 @@ main(int argc, char **argv)
     if (networkTestFlag) {
       kernel->NetworkTest();   // two-machine test of the network
     }
+    if (benchmarkFlag) {
+      kernel->Benchmark();     // time kernel data structures
+    }
 
 #ifndef FILESYS_STUB
     if (removeFileName != NULL) {
@@ -11,8 +11,26 @@
 //	end up calling FindNextToRun(), and that would put us in an 
 //	infinite loop.
 //
-// 	Very simple implementation -- no priorities, straight FIFO.
-//	Might need to be improved in later assignments.
+// 	Round robin is a very simple implementation -- no priorities, 
+//	straight FIFO.  The multilevel feedback queue keeps a FIFO list
+//	per level: threads that keep using up their quantum sink to the
+//	lower levels, which get longer quanta, while threads that block
+//	before their quantum is up (waiting for the console or the disk,
+//	say) stay where they are, ahead of them.  Threads left waiting
+//	at a low level age back up, so they are not starved.  The 
+//	priority scheduler keeps a queue per priority (see RunQueue), so
+//	it takes the same time however many threads are ready.  Shortest
+//	remaining time keeps the ready list sorted by how much longer
+//	each thread is expected to run before it blocks, guessing from 
+//	how long it ran the times before -- which favours threads that
+//	mostly wait for I/O, and so keeps the devices busy.
+//
+//	With more than one CPU (see cpu.h), each has its own ready list.
+//	Interrupts being disabled on one CPU doesn't stop the others, but
+//	the CPUs only take turns where simulated time advances, which
+//	these routines never do.  A thread goes back to the CPU it last
+//	ran on, unless another is idle; a CPU that runs out of threads
+//	takes one from whichever CPU has the most.
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -22,17 +40,53 @@
 #include "debug.h"
 #include "scheduler.h"
 #include "main.h"
+#include "hostthread.h"
+
+//----------------------------------------------------------------------
+// BurstCompare
+// 	Order threads for a sorted ready list: the one expected to 
+//	block soonest first, first come first served among equals.
+//----------------------------------------------------------------------
+
+static int
+BurstCompare(Thread *x, Thread *y)
+{
+    return x->burstLeft - y->burstLeft;
+}
 
 //----------------------------------------------------------------------
 // Scheduler::Scheduler
 // 	Initialize the list of ready but not running threads.
 //	Initially, no ready threads.
+//
+//	"policy" -- how to choose the next thread to run
+//	"numCpus" -- how many CPUs there are, each with its own list
 //----------------------------------------------------------------------
 
-Scheduler::Scheduler()
+Scheduler::Scheduler(SchedulerPolicy policy, int numCpus)
 { 
-    readyList = new List<Thread *>; 
-    toBeDestroyed = NULL;
+    this->policy = policy;
+    this->numCpus = numCpus;
+    numLevels = (policy == SchedMultiLevel) ? NumLevels : 1;
+    readyList = new List<Thread *> *[numCpus * numLevels];
+    for (int i = 0; i < numCpus * numLevels; i++) {
+	if (policy == SchedShortestFirst)
+	    readyList[i] = new SortedList<Thread *>(BurstCompare);
+	else
+	    readyList[i] = new List<Thread *>; 
+    }
+    runQueue = NULL;
+    if (policy == SchedPriority) {
+	runQueue = new RunQueue *[numCpus];
+	for (int i = 0; i < numCpus; i++)
+	    runQueue[i] = new RunQueue;
+    }
+    numReady = new int[numCpus];
+    toBeDestroyed = new Thread *[numCpus];
+    for (int i = 0; i < numCpus; i++) {
+	numReady[i] = 0;
+	toBeDestroyed[i] = NULL;
+    }
 } 
 
 //----------------------------------------------------------------------
@@ -42,7 +96,16 @@ Scheduler::Scheduler()
 
 Scheduler::~Scheduler()
 { 
-    delete readyList; 
+    for (int i = 0; i < numCpus * numLevels; i++)
+	delete readyList[i]; 
+    delete [] readyList;
+    if (runQueue != NULL) {
+	for (int i = 0; i < numCpus; i++)
+	    delete runQueue[i];
+	delete [] runQueue;
+    }
+    delete [] numReady;
+    delete [] toBeDestroyed;
 } 
 
 //----------------------------------------------------------------------
@@ -50,22 +113,68 @@ Scheduler::~Scheduler()
 // 	Mark a thread as ready, but not running.
 //	Put it on the ready list, for later scheduling onto the CPU.
 //
+//	The list is that of the CPU the thread last ran on (or, if it
+//	is new, the CPU forking it) -- unless that CPU is busy and
+//	another is idle, in which case the idle one gets it, and is
+//	woken up with an inter-processor interrupt.
+//
+//	A CPU busy running a thread needs its timer, now that there is
+//	another waiting; an idle one will run it straight away.
+//
+//	With shortest remaining time, a thread expected to block sooner
+//	than the one running on the CPU should preempt it.  If that CPU
+//	is another one, it is interrupted, to reschedule; if it is this
+//	one, and this is an interrupt handler, the thread yields on 
+//	return.  Otherwise it is left to the next timer interrupt.
+//
 //	"thread" is the thread to be put on the ready list.
 //----------------------------------------------------------------------
 
 void
 Scheduler::ReadyToRun (Thread *thread)
 {
+    Cpu *cpu = (thread->cpu == -1) ? kernel->cpu : kernel->cpus[thread->cpu];
+    int now = kernel->stats->totalTicks;
+
     ASSERT(kernel->interrupt->getLevel() == IntOff);
     DEBUG(dbgThread, "Putting thread on ready list: " << thread->getName());
 	//cout << "Putting thread on ready list: " << thread->getName() << endl ;
+    thread->burstLeft = BurstLeft(thread);
     thread->setStatus(READY);
-    readyList->Append(thread);
+    thread->readySince = thread->agedAt = now;
+    if (thread->arrivalTime == -1)
+	thread->arrivalTime = now;
+    for (int i = 0; i < numCpus && !cpu->idle; i++) {
+	if (kernel->cpus[i]->idle)
+	    cpu = kernel->cpus[i];
+    }
+    if (runQueue != NULL)
+	runQueue[cpu->id]->Append(thread);
+    else
+	ReadyList(cpu->id, LevelOf(thread))->Append(thread);
+    numReady[cpu->id]++;
+    if (cpu->idle) {
+	kernel->interrupt->SendIPI(cpu);
+	return;
+    }
+    if (cpu != kernel->cpu || kernel->interrupt->getStatus() != IdleMode)
+	cpu->alarm->StartSlicing();
+    if (policy == SchedShortestFirst) {
+	if (cpu != kernel->cpu) {
+	    if (thread->burstLeft < BurstLeft(cpu->thread))
+		kernel->interrupt->SendIPI(cpu);
+	} else if (kernel->interrupt->InHandler() 
+		&& kernel->interrupt->getStatus() != IdleMode
+		&& thread->burstLeft < BurstLeft(kernel->currentThread)) {
+	    kernel->interrupt->YieldOnReturn(TRUE);
+	}
+    }
 }
 
 //----------------------------------------------------------------------
 // Scheduler::FindNextToRun
-// 	Return the next thread to be scheduled onto the CPU.
+// 	Return the next thread to be scheduled onto the CPU: the first
+//	on the highest level that has any.
 //	If there are no ready threads, return NULL.
 // Side effect:
 //	Thread is removed from the ready list.
@@ -74,13 +183,28 @@ Scheduler::ReadyToRun (Thread *thread)
 Thread *
 Scheduler::FindNextToRun ()
 {
+    int cpu = kernel->cpu->id;
+    List<Thread *> *list;
+
     ASSERT(kernel->interrupt->getLevel() == IntOff);
 
-    if (readyList->IsEmpty()) {
+    for (int i = 0; i < numCpus && numReady[cpu] == 0; i++) {
+	if (numReady[i] > numReady[cpu])
+	    cpu = i;			// the longest, if ours is empty
+    }
+    if (numReady[cpu] == 0) {
 		return NULL;
-    } else {
-    	return readyList->RemoveFront();
     }
+    numReady[cpu]--;
+    if (runQueue != NULL)
+	return runQueue[cpu]->RemoveFirst();
+    for (int level = 0; level < numLevels; level++) {
+	list = ReadyList(cpu, level);
+	if (!list->IsEmpty())
+	    return list->RemoveFront();
+    }
+    ASSERTNOTREACHED();
+    return NULL;
 }
 
 //----------------------------------------------------------------------
@@ -104,12 +228,42 @@ void
 Scheduler::Run (Thread *nextThread, bool finishing)
 {
     Thread *oldThread = kernel->currentThread;
+    int now = kernel->stats->totalTicks;
     
     ASSERT(kernel->interrupt->getLevel() == IntOff);
 
+    oldThread->runTicks += now - oldThread->runningSince;
+    oldThread->quantumUsed += now - oldThread->runningSince;
+    oldThread->burstTicks += now - oldThread->runningSince;
+    if (oldThread->getStatus() == BLOCKED) {	// end of its CPU burst
+	oldThread->predictedBurst = 
+		(oldThread->predictedBurst + oldThread->burstTicks) / 2;
+	if (oldThread->predictedBurst < 1)
+	    oldThread->predictedBurst = 1;
+	oldThread->burstTicks = 0;
+    }
+    CountSwitch(oldThread, nextThread, finishing);
     if (finishing) {	// mark that we need to delete current thread
-         ASSERT(toBeDestroyed == NULL);
-	 toBeDestroyed = oldThread;
+         ASSERT(toBeDestroyed[kernel->cpu->id] == NULL);
+	 toBeDestroyed[kernel->cpu->id] = oldThread;
+	 if (oldThread->arrivalTime != -1) {
+	    Statistics *stats = kernel->stats;
+
+	    DEBUG(dbgThread, "Thread " << oldThread->getName() 
+		<< " done: turnaround " << now - oldThread->arrivalTime
+		<< ", response " << oldThread->firstRunTime 
+					- oldThread->arrivalTime
+		<< ", waited " << oldThread->waitTicks 
+		<< ", ran " << oldThread->runTicks
+		<< ", switches: voluntary " << oldThread->voluntarySwitches
+		<< ", involuntary " << oldThread->involuntarySwitches
+		<< ", preempted " << oldThread->preemptions);
+	    stats->numThreadsDone++;
+	    stats->turnaroundTicks += now - oldThread->arrivalTime;
+	    stats->responseTicks += oldThread->firstRunTime 
+					- oldThread->arrivalTime;
+	    stats->readyTicks += oldThread->waitTicks;
+	 }
     }
     
     if (oldThread->space != NULL) {	// if this thread is a user program,
@@ -121,7 +275,22 @@ Scheduler::Run (Thread *nextThread, bool finishing)
 					    // had an undetected stack overflow
 
     kernel->currentThread = nextThread;  // switch to the next thread
+    if (nextThread->getStatus() == READY) {
+	if (now > nextThread->readySince)   // it may have come from a
+	    nextThread->waitTicks += now - nextThread->readySince;
+					    // CPU further on in time
+	if (nextThread->firstRunTime == -1)
+	    nextThread->firstRunTime = now;
+    }
+    nextThread->runningSince = now;
     nextThread->setStatus(RUNNING);      // nextThread is now running
+    if (numReady[kernel->cpu->id] > 0)	    // others still waiting
+	kernel->alarm->StartSlicing();
+    if (nextThread->cpu != kernel->cpu->id) {
+	if (nextThread->cpu != -1)
+	    kernel->stats->numMigrations++;
+	nextThread->cpu = kernel->cpu->id;
+    }
     
     DEBUG(dbgThread, "Switching from: " << oldThread->getName() << " to: " << nextThread->getName());
     
@@ -129,8 +298,13 @@ Scheduler::Run (Thread *nextThread, bool finishing)
     // in switch.s.  You may have to think
     // a bit to figure out what happens after this, both from the point
     // of view of the thread and from the perspective of the "outside world".
+    // With -hostthreads, the threads are on host threads of their own,
+    // which take turns instead (see hostthread.h).
 
-    SWITCH(oldThread, nextThread);
+    if (kernel->hostThreads)
+	HostThread::Switch(oldThread, nextThread, finishing);
+    else
+	SWITCH(oldThread, nextThread);
 
     // we're back, running oldThread
       
@@ -149,6 +323,237 @@ Scheduler::Run (Thread *nextThread, bool finishing)
     }
 }
 
+//----------------------------------------------------------------------
+// Scheduler::CountSwitch
+// 	Account for a context switch from oldThread to nextThread, in the
+//	statistics of the old thread and of the whole system: whether
+//	the old thread gave up the CPU itself, or an interrupt handler
+//	made it yield; how many threads are left waiting for the CPU;
+//	and how many switches there are in each stretch of time.
+//
+//	Called by Run, before nextThread's status changes.
+//----------------------------------------------------------------------
+
+void
+Scheduler::CountSwitch(Thread *oldThread, Thread *nextThread, 
+							bool finishing)
+{
+    Statistics *stats = kernel->stats;
+    int now = stats->totalTicks;
+    YieldReason reason = kernel->interrupt->TakeYieldReason();
+    int oldID = oldThread->getID();
+    int nextID = nextThread->getID();
+    int waited = 0;
+    int window = now / SwitchRateWindow;
+
+    if (nextThread->getStatus() == READY && now > nextThread->readySince)
+	waited = now - nextThread->readySince;
+
+    if (finishing) {
+	TRACE(dbgThread, TraceSwitchFinish, oldID, nextID, waited);
+    } else if (oldThread->getStatus() == BLOCKED) {
+	TRACE(dbgThread, TraceSwitchBlock, oldID, nextID, waited);
+    } else if (reason == SliceYield) {
+	TRACE(dbgThread, TraceSwitchSlice, oldID, nextID, waited);
+    } else if (reason == PreemptYield) {
+	TRACE(dbgThread, TraceSwitchPreempt, oldID, nextID, waited);
+    } else {
+	TRACE(dbgThread, TraceSwitchYield, oldID, nextID, waited);
+    }
+    if (finishing || oldThread->getStatus() == BLOCKED 
+						|| reason == OwnYield) {
+	oldThread->voluntarySwitches++;
+	stats->numVoluntarySwitches++;
+    } else {
+	oldThread->involuntarySwitches++;
+	stats->numInvoluntarySwitches++;
+	if (reason == PreemptYield) {
+	    oldThread->preemptions++;
+	    stats->numPreemptions++;
+	}
+    }
+
+    stats->numSwitches++;
+    stats->readyLength.Add(numReady[kernel->cpu->id]);
+    if (window > stats->switchWindow) {	// a new stretch of time
+	stats->switchRate.Add(stats->windowSwitches);
+	stats->switchRate.Add(0, window - stats->switchWindow - 1);
+					// ones with no switches at all
+	stats->switchWindow = window;
+	stats->windowSwitches = 0;
+    }
+    stats->windowSwitches++;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::ShouldPreempt
+// 	Called from a timer interrupt handler, with interrupts disabled:
+//	should the running thread be made to give up the CPU?
+//
+//	With round robin, always.  With priorities, if another thread
+//	with at least the same priority is ready.  With shortest
+//	remaining time, if another thread is expected to block sooner.
+//	With the multilevel feedback queue, only if its quantum is up
+//	-- in which case it drops a level -- or a thread at a higher
+//	level is ready.  If the quantum is up but only lower levels are
+//	ready, it carries on with a new one.  Threads waiting to run
+//	are aged at the same time.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::ShouldPreempt()
+{
+    Thread *thread = kernel->currentThread;
+    int cpu = kernel->cpu->id;
+    int level, used;
+
+    if (policy == SchedRoundRobin)
+	return TRUE;
+    if (policy == SchedPriority)
+	return runQueue[cpu]->MaxPriorityReady() >= thread->priority;
+    if (policy == SchedShortestFirst) {
+	used = thread->burstTicks + kernel->stats->totalTicks 
+					- thread->runningSince;
+	while (used >= thread->predictedBurst) {
+	    thread->predictedBurst *= 2;	// it guessed too short
+	    DEBUG(dbgThread, "Thread " << thread->getName() 
+		<< " ran past its burst, now expected to take " 
+		<< thread->predictedBurst);
+	}
+	return !ReadyList(cpu, 0)->IsEmpty() 
+	    && ReadyList(cpu, 0)->Front()->burstLeft < BurstLeft(thread);
+    }
+
+    Age();
+    level = LevelOf(thread);
+    used = thread->quantumUsed + kernel->stats->totalTicks 
+					- thread->runningSince;
+    if (used >= Quantum(level)) {
+	if (level < numLevels - 1) {
+	    thread->priority -= PriorityPerLevel;
+	    if (thread->priority < 0)
+		thread->priority = 0;
+	    DEBUG(dbgThread, "Thread " << thread->getName() 
+		<< " used up its quantum, down to priority " 
+		<< thread->priority);
+	    level = LevelOf(thread);
+	}
+	thread->quantumUsed = thread->runningSince 
+				- kernel->stats->totalTicks;  // start afresh
+	level++;			// same level goes round robin
+    }
+    for (int i = 0; i < level && i < numLevels; i++) {
+	if (!ReadyList(cpu, i)->IsEmpty())
+	    return TRUE;
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::SetPriority
+// 	Change the priority of "thread" to "priority".  If it is on a
+//	priority ready queue, which is ordered by priority, take it off
+//	and put it back at the end of its new one.  (The other ready
+//	lists don't change order with priority, or can wait for it --
+//	the multilevel lists are rearranged as threads age.)
+//----------------------------------------------------------------------
+
+void
+Scheduler::SetPriority(Thread *thread, int priority)
+{
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    ASSERT(priority >= 0 && priority <= MaxPriority);
+
+    if (runQueue != NULL && thread->getStatus() == READY) {
+	for (int i = 0; i < numCpus; i++) {
+	    if (runQueue[i]->Holds(thread)) {
+		runQueue[i]->Remove(thread);
+		thread->priority = priority;
+		runQueue[i]->Append(thread);
+		return;
+	    }
+	}
+	ASSERTNOTREACHED();
+    }
+    thread->priority = priority;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::LevelOf
+// 	Which level of ready list a thread belongs on: the highest
+//	priorities are on level 0.
+//----------------------------------------------------------------------
+
+int
+Scheduler::LevelOf(Thread *thread)
+{
+    if (numLevels == 1)
+	return 0;
+    return (MaxPriority - thread->priority) / PriorityPerLevel;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Age
+// 	Raise the priority of every thread that has been ready for
+//	AgingTicks since it was made ready (or last aged), moving it up a 
+//	level if need be.  Threads that stay on the same level keep
+//	their place.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Age()
+{
+    int now = kernel->stats->totalTicks;
+    List<Thread *> *list;
+    Thread *thread;
+    int n, level;
+
+    for (int cpu = 0; cpu < numCpus; cpu++) {
+	for (int i = 1; i < numLevels; i++) {
+	    list = ReadyList(cpu, i);
+	    for (n = list->NumInList(); n > 0; n--) {
+		thread = list->RemoveFront();
+		if (now - thread->agedAt >= AgingTicks
+			&& thread->priority < MaxPriority) {
+		    thread->priority += AgingBoost;
+		    if (thread->priority > MaxPriority)
+			thread->priority = MaxPriority;
+		    thread->agedAt = now;
+		    level = LevelOf(thread);
+		    if (level != i) {
+			DEBUG(dbgThread, "Thread " << thread->getName() 
+			    << " aged up to priority " << thread->priority);
+			thread->quantumUsed = 0;
+		    }
+		    ReadyList(cpu, level)->Append(thread);
+		} else {
+		    list->Append(thread);
+		}
+	    }
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::BurstLeft
+// 	How much longer a thread is expected to run before it next 
+//	blocks: its predicted burst, less what it has run of it so far
+//	-- including, if it is running, the time since it was 
+//	dispatched.  Zero if it has already run longer.
+//----------------------------------------------------------------------
+
+int
+Scheduler::BurstLeft(Thread *thread)
+{
+    int used = thread->burstTicks;
+
+    if (thread->getStatus() == RUNNING)
+	used += kernel->stats->totalTicks - thread->runningSince;
+    if (used >= thread->predictedBurst)
+	return 0;
+    return thread->predictedBurst - used;
+}
+
 //----------------------------------------------------------------------
 // Scheduler::CheckToBeDestroyed
 // 	If the old thread gave up the processor because it was finishing,
@@ -160,9 +565,11 @@ Scheduler::Run (Thread *nextThread, bool finishing)
 void
 Scheduler::CheckToBeDestroyed()
 {
-    if (toBeDestroyed != NULL) {
-        delete toBeDestroyed;
-	toBeDestroyed = NULL;
+    int cpu = kernel->cpu->id;
+
+    if (toBeDestroyed[cpu] != NULL) {
+        delete toBeDestroyed[cpu];
+	toBeDestroyed[cpu] = NULL;
     }
 }
  
@@ -175,5 +582,276 @@ void
 Scheduler::Print()
 {
     cout << "Ready list contents:\n";
-    readyList->Apply(ThreadPrint);
+    for (int i = 0; i < numCpus; i++) {
+	if (runQueue != NULL) {
+	    if (numCpus > 1)
+		cout << "CPU " << i << ": ";
+	    runQueue[i]->Apply(ThreadPrint);
+	    if (numCpus > 1)
+		cout << "\n";
+	    continue;
+	}
+	for (int level = 0; level < numLevels; level++) {
+	    if (numCpus > 1)
+		cout << "CPU " << i << ": ";
+	    if (numLevels > 1)
+		cout << "level " << level << ": ";
+	    ReadyList(i, level)->Apply(ThreadPrint);
+	    if (numCpus > 1 || numLevels > 1)
+		cout << "\n";
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// RunQueue::RunQueue
+// 	Initialize an empty queue of ready threads.
+//----------------------------------------------------------------------
+
+RunQueue::RunQueue()
+{
+    for (int i = 0; i <= MaxPriority; i++)
+	first[i] = last[i] = NULL;
+    for (int w = 0; w < PriorityWords; w++)
+	bitmap[w] = 0;
+    summary = 0;
+    numInQueue = 0;
+}
+
+//----------------------------------------------------------------------
+// RunQueue::Append
+// 	Put a thread at the back of the queue for its priority.
+//----------------------------------------------------------------------
+
+void
+RunQueue::Append(Thread *thread)
+{
+    int slot = MaxPriority - thread->priority;
+
+    ASSERT(thread->priority >= 0 && thread->priority <= MaxPriority);
+    thread->readyNext = NULL;
+    thread->readyPrev = last[slot];
+    if (last[slot] == NULL) {
+	first[slot] = thread;
+	bitmap[slot / 32] |= 1u << (slot % 32);
+	summary |= 1u << (slot / 32);
+    } else {
+	last[slot]->readyNext = thread;
+    }
+    last[slot] = thread;
+    numInQueue++;
+}
+
+//----------------------------------------------------------------------
+// RunQueue::Remove
+// 	Take a thread out of the queue for its priority, wherever it is.
+//----------------------------------------------------------------------
+
+void
+RunQueue::Remove(Thread *thread)
+{
+    int slot = MaxPriority - thread->priority;
+
+    if (thread->readyPrev == NULL) {
+	ASSERT(first[slot] == thread);
+	first[slot] = thread->readyNext;
+    } else {
+	thread->readyPrev->readyNext = thread->readyNext;
+    }
+    if (thread->readyNext == NULL) {
+	ASSERT(last[slot] == thread);
+	last[slot] = thread->readyPrev;
+    } else {
+	thread->readyNext->readyPrev = thread->readyPrev;
+    }
+    thread->readyNext = thread->readyPrev = NULL;
+    if (first[slot] == NULL) {
+	bitmap[slot / 32] &= ~(1u << (slot % 32));
+	if (bitmap[slot / 32] == 0)
+	    summary &= ~(1u << (slot / 32));
+    }
+    numInQueue--;
+}
+
+//----------------------------------------------------------------------
+// RunQueue::Holds
+// 	Return TRUE if "thread" is on this queue, rather than another's.
+//	It is on one of them: find the front of its part of that one.
+//----------------------------------------------------------------------
+
+bool
+RunQueue::Holds(Thread *thread)
+{
+    Thread *front = thread;
+
+    while (front->readyPrev != NULL)
+	front = front->readyPrev;
+    return first[MaxPriority - thread->priority] == front;
+}
+
+//----------------------------------------------------------------------
+// RunQueue::MaxPriorityReady
+// 	Return the highest priority of any thread queued, or -1 if the
+//	queue is empty.
+//----------------------------------------------------------------------
+
+int
+RunQueue::MaxPriorityReady()
+{
+    int w;
+
+    if (summary == 0)
+	return -1;
+    w = __builtin_ctz(summary);
+    return MaxPriority - (32 * w + __builtin_ctz(bitmap[w]));
+}
+
+//----------------------------------------------------------------------
+// RunQueue::RemoveFirst
+// 	Dequeue and return the first thread of the highest priority
+//	queued, or NULL if there are none.
+//----------------------------------------------------------------------
+
+Thread *
+RunQueue::RemoveFirst()
+{
+    int priority = MaxPriorityReady();
+    Thread *thread;
+
+    if (priority == -1)
+	return NULL;
+    thread = first[MaxPriority - priority];
+    Remove(thread);
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// RunQueue::Apply
+// 	Call "func" on every thread queued, highest priority first.
+//----------------------------------------------------------------------
+
+void
+RunQueue::Apply(void (*func)(Thread *))
+{
+    for (int slot = 0; slot <= MaxPriority; slot++) {
+	for (Thread *t = first[slot]; t != NULL; t = t->readyNext)
+	    (*func)(t);
+    }
+}
+
+//----------------------------------------------------------------------
+// BenchThread
+// 	The body of each thread the benchmark forks: yield the CPU a
+//	few times, then finish.
+//----------------------------------------------------------------------
+
+static void
+BenchThread(int numYields)
+{
+    for (int i = 0; i < numYields; i++)
+	kernel->currentThread->Yield();
+}
+
+//----------------------------------------------------------------------
+// PriorityCompare
+// 	Order threads for a sorted list: highest priority first.
+//----------------------------------------------------------------------
+
+static int
+PriorityCompare(Thread *x, Thread *y)
+{
+    return y->priority - x->priority;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Benchmark
+// 	Time this scheduler with many threads: fork "numThreads" kernel
+//	threads, of priorities all across the range, that each yield
+//	"numYields" times and finish, and wait for them all.
+//
+//	Then time the ready queue on its own against a sorted list, 
+//	which is how a priority scheduler would be built on the List 
+//	classes: take off the most urgent of "numThreads" ready threads 
+//	over and over, and put it back with a new priority.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Benchmark(int numThreads, int numYields)
+{
+    Thread *current = kernel->currentThread;
+    int oldPriority = current->priority;
+    RunQueue *queue = new RunQueue;
+    SortedList<Thread *> *list = new SortedList<Thread *>(PriorityCompare);
+    Thread **threads = new Thread *[numThreads];
+    int *priorities = new int[numThreads];
+    Thread *thread;
+    unsigned int seed, queueSum = 0, listSum = 0;
+    int i, numEvents = numThreads * numYields, startTicks;
+    double start, queueTime, listTime;
+    static char *policyNames[] = { "round robin", "multilevel", "priority",
+				   "shortest remaining time" };
+
+// the next priority; a simple linear congruential generator, so we don't
+// disturb the one used for -rs
+#define NEXT_PRIORITY() \
+    (seed = seed * 1103515245 + 12345, (seed >> 16) % (MaxPriority + 1))
+
+    current->priority = 0;		// let them all go first
+    for (i = 0; i < numThreads; i++)
+	priorities[i] = (i * 37) % (MaxPriority + 1);
+    start = HostTime();
+    startTicks = kernel->stats->totalTicks;
+    Thread::ForkAndJoin("benchmark", numThreads,
+		(VoidFunctionPtr) BenchThread, (void *) numYields, priorities);
+    cout << "Scheduler (" << policyNames[policy] << "), " << numThreads 
+	<< " threads, " << numYields << " yields each: " 
+	<< HostTime() - start << " s, " 
+	<< kernel->stats->totalTicks - startTicks << " ticks\n";
+    current->priority = oldPriority;
+
+    seed = 1;
+    for (i = 0; i < numThreads; i++) {
+	threads[i] = new Thread("benchmark", i);
+	threads[i]->priority = NEXT_PRIORITY();
+	queue->Append(threads[i]);
+    }
+    start = HostTime();
+    for (i = 0; i < numEvents; i++) {
+	thread = queue->RemoveFirst();
+	queueSum += thread->priority;
+	thread->priority = NEXT_PRIORITY();
+	queue->Append(thread);
+    }
+    queueTime = HostTime() - start;
+    while (!queue->IsEmpty())
+	(void) queue->RemoveFirst();
+
+    seed = 1;
+    for (i = 0; i < numThreads; i++) {
+	threads[i]->priority = NEXT_PRIORITY();
+	list->Insert(threads[i]);
+    }
+    start = HostTime();
+    for (i = 0; i < numEvents; i++) {
+	thread = list->RemoveFront();
+	listSum += thread->priority;
+	thread->priority = NEXT_PRIORITY();
+	list->Insert(thread);
+    }
+    listTime = HostTime() - start;
+#undef NEXT_PRIORITY
+
+    ASSERT(queueSum == listSum);	// same priorities, same order
+    cout << "Ready queue, " << numThreads << " threads, " << numEvents 
+	<< " dispatches: run queue " << queueTime << " s, sorted list " 
+	<< listTime << " s\n";
+
+    while (!list->IsEmpty())
+	(void) list->RemoveFront();
+    for (i = 0; i < numThreads; i++)
+	delete threads[i];
+    delete [] threads;
+    delete [] priorities;
+    delete list;
+    delete queue;
 }
@@ -12,6 +12,78 @@
 #include "copyright.h"
 #include "list.h"
 #include "thread.h"
+#include "stats.h"
+
+// How the scheduler chooses among ready threads:
+//	round robin -- one FIFO ready list, and every timer interrupt
+//		switches threads
+//	multilevel feedback -- a FIFO list per priority level, each with
+//		its own quantum.  A thread that uses up its quantum drops a
+//		level; one that waits long enough on a ready list ages up.
+//	priority -- the highest priority ready thread runs, first come
+//		first served among equals, which share the CPU round
+//		robin.  Priorities are fixed.
+//	shortest remaining time -- the thread expected to finish its
+//		CPU burst (to run until it next blocks) soonest runs, and
+//		a thread made ready preempts one expected to take longer.
+//		How long a burst will take is predicted from the ones
+//		before it.
+enum SchedulerPolicy { SchedRoundRobin, SchedMultiLevel, SchedPriority,
+		       SchedShortestFirst };
+
+// Multilevel feedback queue parameters.  Priorities (see thread.h) are
+// split into levels of PriorityPerLevel each, the highest priorities
+// making up level 0; the quantum doubles at each level down.
+const int NumLevels = 3;
+const int PriorityPerLevel = (MaxPriority + NumLevels) / NumLevels;
+const int AgingTicks = 1500;	// time ready before a thread ages
+const int AgingBoost = 10;	// priority it gains when it does
+
+// CPU burst prediction, for shortest remaining time.  A thread's first
+// burst is guessed to take InitialBurst; after that, each guess is the
+// average of the last guess and the burst that actually followed it,
+// so older bursts count for less and less.  A thread that runs past
+// its guess has it doubled.
+const int InitialBurst = TimerTicks;
+
+// The following class defines the ready threads of a priority 
+// scheduler, queued in constant time whatever their number or priority.
+// There is a FIFO queue per priority, linked through the threads 
+// themselves, and a bitmap of which queues are non-empty, with a bit
+// per word of that saying which words are non-zero.  The highest 
+// priority is found by looking for the first bit set, in each.
+//
+// A thread's priority must not change while it is queued.
+
+const int PriorityWords = (MaxPriority + 32) / 32;
+
+class RunQueue {
+  public:
+    RunQueue();			// Initialize an empty queue
+
+    void Append(Thread *thread);// Queue a thread, behind any others
+				// of the same priority
+    Thread *RemoveFirst();	// Dequeue the first thread of the
+				// highest priority; NULL if none
+    void Remove(Thread *thread);// Dequeue a particular thread
+    bool Holds(Thread *thread);	// Is "thread" on this queue?
+
+    bool IsEmpty() { return summary == 0; }
+    int MaxPriorityReady();	// Highest priority queued; -1 if none
+    int NumInQueue() { return numInQueue; }
+    void Apply(void (*func)(Thread *));
+				// Call "func" on each thread, in the 
+				// order they would be dequeued
+
+  private:
+    Thread *first[MaxPriority + 1];	// queue for each priority
+    Thread *last[MaxPriority + 1];
+    unsigned int bitmap[PriorityWords];	// bit i of word w set if the
+				// queue for MaxPriority - (32 * w + i)
+				// has anything in it
+    unsigned int summary;	// bit w set if bitmap[w] is non-zero
+    int numInQueue;
+};
 
 // The following class defines the scheduler/dispatcher abstraction -- 
 // the data structures and operations needed to keep track of which 
@@ -19,26 +91,62 @@
 
 class Scheduler {
   public:
-    Scheduler();		// Initialize list of ready threads 
+    Scheduler(SchedulerPolicy policy, int numCpus);
+				// Initialize list of ready threads,
+				// one per CPU (and per level)
     ~Scheduler();		// De-allocate ready list
 
     void ReadyToRun(Thread* thread);	
     				// Thread can be dispatched.
     Thread* FindNextToRun();	// Dequeue first thread on the ready 
 				// list, if any, and return thread.
+				// If this CPU's list is empty, take
+				// one from the longest of the others
     void Run(Thread* nextThread, bool finishing);
     				// Cause nextThread to start running
+    bool ShouldPreempt();	// Called on a timer interrupt: should
+				// the running thread give up the CPU?
+    void SetPriority(Thread *thread, int priority);
+				// Change a thread's priority, moving
+				// it on the ready queue if need be
+    int NumReady(int cpu) { return numReady[cpu]; }
+				// Threads waiting for "cpu"
     void CheckToBeDestroyed();// Check if thread that had been
     				// running needs to be deleted
     void Print();		// Print contents of ready list
     
     // SelfTest for scheduler is implemented in class Thread
+
+    void Benchmark(int numThreads, int numYields);
+				// Time scheduling many threads
     
   private:
-    List<Thread *> *readyList;  // queue of threads that are ready to run,
-				// but not running
-    Thread *toBeDestroyed;	// finishing thread to be destroyed
-    				// by the next thread that runs
+    SchedulerPolicy policy;
+    int numCpus;
+    int numLevels;		// 1, unless multilevel
+    List<Thread *> **readyList; // queue of threads that are ready to run,
+				// but not running, for each CPU and
+				// level; sorted by BurstLeft, if
+				// shortest remaining time
+    RunQueue **runQueue;	// each CPU's ready threads, if they are
+				// scheduled by priority; else NULL
+    int *numReady;		// threads on each CPU's lists
+    Thread **toBeDestroyed;	// finishing thread to be destroyed
+    				// by the next thread that runs, on
+				// each CPU
+
+    List<Thread *> *ReadyList(int cpu, int level)
+		{ return readyList[cpu * numLevels + level]; }
+    int LevelOf(Thread *thread);// Which list "thread" belongs on
+    int Quantum(int level) { return TimerTicks << level; }
+    void Age();			// Promote threads that have waited
+				// long enough
+    int BurstLeft(Thread *thread);
+				// How much longer "thread" is expected
+				// to run before it blocks
+    void CountSwitch(Thread *oldThread, Thread *nextThread, 
+							bool finishing);
+				// Account for a context switch
 };
 
 #endif // SCHEDULER_H
@@ -16,17 +16,12 @@
 // re-set the interrupt state back to its original value (whether
 // that be disabled or enabled).
 //
-// Once we'e implemented one set of higher level atomic operations,
-// we can implement others using that implementation.  We illustrate
-// this by implementing locks and condition variables on top of 
-// semaphores, instead of directly enabling and disabling interrupts.
-//
-// Locks are implemented using a semaphore to keep track of
-// whether the lock is held or not -- a semaphore value of 0 means
-// the lock is busy; a semaphore value of 1 means the lock is free.
-//
-// The implementation of condition variables using semaphores is
-// a bit trickier, as explained below under Condition::Wait.
+// Semaphores, locks and condition variables each keep their own queue
+// of waiting threads (a WaitQueue), linked through the threads, so
+// that waiting never allocates anything.  A thread that is woken is
+// handed what it was waiting for -- the semaphore's increment, or the
+// lock -- before it runs, so it never has to check again and go back
+// to sleep.
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -36,6 +31,100 @@
 #include "synch.h"
 #include "main.h"
 
+//----------------------------------------------------------------------
+// WaitQueue::Append
+// 	Put a thread at the end of the queue.  The thread must not be
+//	on any other WaitQueue.
+//----------------------------------------------------------------------
+
+void
+WaitQueue::Append(Thread *thread)
+{
+    thread->waitNext = NULL;
+    if (first == NULL) {
+	first = thread;
+    } else {
+	last->waitNext = thread;
+    }
+    last = thread;
+}
+
+//----------------------------------------------------------------------
+// WaitQueue::RemoveFront
+// 	Take the first thread off the queue, and return it; or return
+//	NULL if the queue is empty.
+//----------------------------------------------------------------------
+
+Thread *
+WaitQueue::RemoveFront()
+{
+    Thread *thread = first;
+
+    if (thread != NULL) {
+	first = thread->waitNext;
+	thread->waitNext = NULL;
+    }
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// WaitQueue::Splice
+// 	Move all the threads on "other" onto the end of this queue,
+//	in order, leaving "other" empty.  Takes the same time however
+//	many there are.
+//----------------------------------------------------------------------
+
+void
+WaitQueue::Splice(WaitQueue *other)
+{
+    if (other->first == NULL)
+	return;
+    if (first == NULL) {
+	first = other->first;
+    } else {
+	last->waitNext = other->first;
+    }
+    last = other->last;
+    other->first = other->last = NULL;
+}
+
+//----------------------------------------------------------------------
+// WaitQueue::Highest, WaitQueue::RemoveHighest
+// 	Return the first thread of the highest priority on the queue,
+//	or NULL if it is empty; RemoveHighest also takes it off.  These
+//	look through the whole queue -- which, being of threads waiting
+//	on one thing, is short.
+//----------------------------------------------------------------------
+
+Thread *
+WaitQueue::Highest()
+{
+    Thread *highest = first;
+
+    for (Thread *t = first; t != NULL; t = t->waitNext) {
+	if (t->priority > highest->priority)
+	    highest = t;
+    }
+    return highest;
+}
+
+Thread *
+WaitQueue::RemoveHighest()
+{
+    Thread *highest = Highest();
+    Thread *prev = NULL;
+
+    if (highest == NULL || highest == first)
+	return RemoveFront();
+    for (prev = first; prev->waitNext != highest; prev = prev->waitNext)
+	;
+    prev->waitNext = highest->waitNext;
+    if (last == highest)
+	last = prev;
+    highest->waitNext = NULL;
+    return highest;
+}
+
 //----------------------------------------------------------------------
 // Semaphore::Semaphore
 // 	Initialize a semaphore, so that it can be used for synchronization.
@@ -48,7 +137,6 @@ Semaphore::Semaphore(char* debugName, int initialValue)
 {
     name = debugName;
     value = initialValue;
-    queue = new List<Thread *>;
 }
 
 //----------------------------------------------------------------------
@@ -59,7 +147,6 @@ Semaphore::Semaphore(char* debugName, int initialValue)
 
 Semaphore::~Semaphore()
 {
-    delete queue;
 }
 
 //----------------------------------------------------------------------
@@ -68,6 +155,9 @@ Semaphore::~Semaphore()
 //	value and decrementing must be done atomically, so we
 //	need to disable interrupts before checking the value.
 //
+//	A thread that has to wait is woken by V() only once it has been
+//	given the increment, so it need not check the value again.
+//
 //	Note that Thread::Sleep assumes that interrupts are disabled
 //	when it is called.
 //----------------------------------------------------------------------
@@ -82,11 +172,12 @@ Semaphore::P()
     // disable interrupts
     IntStatus oldLevel = interrupt->SetLevel(IntOff);	
     
-    while (value == 0) { 		// semaphore not available
-	queue->Append(currentThread);	// so go to sleep
-	currentThread->Sleep(FALSE);
-    } 
-    value--; 			// semaphore available, consume its value
+    if (value > 0) {
+	value--; 		// semaphore available, consume its value
+    } else {			// semaphore not available
+	queue.Append(currentThread);	// so go to sleep, until
+	currentThread->Sleep(FALSE);	// V() hands us its increment
+    }
    
     // re-enable interrupts
     (void) interrupt->SetLevel(oldLevel);	
@@ -95,6 +186,8 @@ Semaphore::P()
 //----------------------------------------------------------------------
 // Semaphore::V
 // 	Increment semaphore value, waking up a waiter if necessary.
+//	If there is a waiter, the increment is handed straight to it,
+//	leaving the value at 0, so no other thread can take it first.
 //	As with P(), this operation must be atomic, so we need to disable
 //	interrupts.  Scheduler::ReadyToRun() assumes that interrupts
 //	are disabled when it is called.
@@ -108,11 +201,13 @@ Semaphore::V()
     
     // disable interrupts
     IntStatus oldLevel = interrupt->SetLevel(IntOff);	
+    Thread *waiter = queue.RemoveFront();
     
-    if (!queue->IsEmpty()) {  // make thread ready.
-	kernel->scheduler->ReadyToRun(queue->RemoveFront());
+    if (waiter != NULL) {	// make thread ready, with the increment
+	kernel->scheduler->ReadyToRun(waiter);
+    } else {
+	value++;
     }
-    value++;
     
     // re-enable interrupts
     (void) interrupt->SetLevel(oldLevel);
@@ -160,8 +255,9 @@ Semaphore::SelfTest()
 Lock::Lock(char* debugName)
 {
     name = debugName;
-    semaphore = new Semaphore("lock", 1);  // initially, unlocked
-    lockHolder = NULL;
+    lockHolder = NULL;		// initially, unlocked
+    heldSince = 0;
+    nextHeld = NULL;
 }
 
 //----------------------------------------------------------------------
@@ -170,28 +266,39 @@ Lock::Lock(char* debugName)
 //----------------------------------------------------------------------
 Lock::~Lock()
 {
-    delete semaphore;
 }
 
 //----------------------------------------------------------------------
 // Lock::Acquire
 //	Atomically wait until the lock is free, then set it to busy.
-//	Equivalent to Semaphore::P(), with the semaphore value of 0
-//	equal to busy, and semaphore value of 1 equal to free.
+//	Like Semaphore::P(): a thread that has to wait is woken only
+//	once Release() has made it the lock holder.
 //----------------------------------------------------------------------
 
 void Lock::Acquire()
 {
-    semaphore->P();
-    lockHolder = kernel->currentThread;
+    Interrupt *interrupt = kernel->interrupt;
+    Thread *currentThread = kernel->currentThread;
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(lockHolder != currentThread);	// would wait forever
+    if (lockHolder == NULL) {
+	Take(currentThread);
+    } else {
+	AddWaiter(currentThread);
+	currentThread->Sleep(FALSE);
+	ASSERT(lockHolder == currentThread);
+    }
+    (void) interrupt->SetLevel(oldLevel);
 }
 
 //----------------------------------------------------------------------
 // Lock::Release
 //	Atomically set lock to be free, waking up a thread waiting
-//	for the lock, if any.
-//	Equivalent to Semaphore::V(), with the semaphore value of 0
-//	equal to busy, and semaphore value of 1 equal to free.
+//	for the lock, if any.  Like Semaphore::V(): if there is a
+//	waiter, the lock isn't freed, but handed to it -- the highest
+//	priority one, if priorities are inherited, or else the one 
+//	that has waited longest.
 //
 //	By convention, only the thread that acquired the lock
 // 	may release it.
@@ -199,9 +306,228 @@ void Lock::Acquire()
 
 void Lock::Release()
 {
+    Interrupt *interrupt = kernel->interrupt;
+    Thread *currentThread = kernel->currentThread;
+    Thread *next;
+    Lock **link;
+    IntStatus oldLevel;
+
     ASSERT(IsHeldByCurrentThread());
+    oldLevel = interrupt->SetLevel(IntOff);
+    if (kernel->priorityInheritance) {
+	for (link = &currentThread->locksHeld; *link != this; 
+						link = &(*link)->nextHeld)
+	    ASSERT(*link != NULL);
+	*link = nextHeld;
+	TakeBackPriority(currentThread);
+	next = queue.RemoveHighest();
+    } else {
+	next = queue.RemoveFront();
+    }
+    TRACE(dbgSynch, TraceLockRelease, currentThread->getID(), 
+	kernel->stats->totalTicks - heldSince, currentThread->priority);
     lockHolder = NULL;
-    semaphore->V();
+    if (next != NULL) {
+	Take(next);
+	kernel->scheduler->ReadyToRun(next);
+    }
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Lock::Take
+//	Make "thread" the holder of the lock, which is free.  With 
+//	priority inheritance, add the lock to those it holds, and have
+//	any threads still waiting for the lock lend it their priority.
+//	Called with interrupts disabled.
+//----------------------------------------------------------------------
+
+void
+Lock::Take(Thread *thread)
+{
+    int now = kernel->stats->totalTicks;
+
+    ASSERT(lockHolder == NULL);
+    lockHolder = thread;
+    heldSince = now;
+    if (thread->waitingFor == NULL)	// it didn't have to wait
+	thread->waitingSince = now;
+    thread->waitingFor = NULL;
+    if (kernel->priorityInheritance) {
+	nextHeld = thread->locksHeld;
+	thread->locksHeld = this;
+	if (!queue.IsEmpty())
+	    LendPriority(queue.Highest());
+    }
+    TRACE(dbgSynch, TraceLockHold, thread->getID(), thread->priority,
+					now - thread->waitingSince);
+}
+
+//----------------------------------------------------------------------
+// Lock::AddWaiter
+//	Queue "thread" to be handed the lock, which is held, when it is
+//	released; with priority inheritance, lending the holder its 
+//	priority.  The thread must be blocked, or about to block.
+//	Called with interrupts disabled.
+//----------------------------------------------------------------------
+
+void
+Lock::AddWaiter(Thread *thread)
+{
+    ASSERT(lockHolder != NULL);
+    TRACE(dbgSynch, TraceLockWait, thread->getID(), thread->priority,
+					lockHolder->getID());
+    thread->waitingFor = this;
+    thread->waitingSince = kernel->stats->totalTicks;
+    queue.Append(thread);
+    if (kernel->priorityInheritance)
+	LendPriority(thread);
+}
+
+//----------------------------------------------------------------------
+// Lock::LendPriority
+//	"thread" is waiting for the lock: raise the holder's priority to
+//	its, if that is higher.  If the holder is itself waiting for a
+//	lock, raise that one's holder too, and so on down the chain.
+//	Called with interrupts disabled.
+//----------------------------------------------------------------------
+
+void
+Lock::LendPriority(Thread *thread)
+{
+    int priority = thread->priority;
+    Thread *holder;
+
+    for (Lock *lock = this; lock != NULL; lock = holder->waitingFor) {
+	holder = lock->lockHolder;
+	if (holder->priority >= priority)
+	    break;			// and so is everyone it waits for
+	TRACE(dbgSynch, TraceLockLend, thread->getID(), priority, 
+					holder->getID());
+	if (holder->ownPriority == -1)
+	    holder->ownPriority = holder->priority;
+	kernel->scheduler->SetPriority(holder, priority);
+    }
+}
+
+//----------------------------------------------------------------------
+// Lock::TakeBackPriority
+//	"thread" has released a lock: drop its priority back to the
+//	highest of its own and those of the threads waiting for the 
+//	locks it still holds.  Called with interrupts disabled.
+//----------------------------------------------------------------------
+
+void
+Lock::TakeBackPriority(Thread *thread)
+{
+    int priority = thread->ownPriority;
+    Thread *waiter;
+
+    if (priority == -1)
+	return;				// it hasn't been lent any
+    for (Lock *lock = thread->locksHeld; lock != NULL; 
+						lock = lock->nextHeld) {
+	waiter = lock->queue.Highest();
+	if (waiter != NULL && waiter->priority > priority)
+	    priority = waiter->priority;
+    }
+    if (priority == thread->ownPriority)
+	thread->ownPriority = -1;	// none lent any more
+    kernel->scheduler->SetPriority(thread, priority);
+}
+
+//----------------------------------------------------------------------
+// Lock::SelfTest, LockTestLow, LockTestMiddle, LockTestHigh
+// 	Test priority inheritance, through a chain of two locks: a low
+//	priority thread holds this lock, a middle priority one holds
+//	another and waits for this one, and a high priority one waits
+//	for the other.  Both holders should run at the high priority
+//	until they release their lock, and then drop back.
+//
+//	The test runs at the lowest priority, and yields until each 
+//	thread it forks has blocked (which, with more than one CPU, may
+//	take more than one try).  Without priority inheritance, it does
+//	nothing.
+//----------------------------------------------------------------------
+
+static Lock *testFirst, *testSecond;	// the chain of locks
+static Semaphore *testGo;		// lets the low thread release
+static Semaphore *testDone;		// V'd as each thread finishes
+
+static void
+LockTestLow(int priority)
+{
+    testFirst->Acquire();
+    testGo->P();
+    testFirst->Release();
+    ASSERT(kernel->currentThread->priority == priority);
+    testDone->V();
+}
+
+static void
+LockTestMiddle(int priority)
+{
+    testSecond->Acquire();
+    testFirst->Acquire();
+    testFirst->Release();
+    ASSERT(kernel->currentThread->priority == MaxPriority);
+    testSecond->Release();
+    ASSERT(kernel->currentThread->priority == priority);
+    testDone->V();
+}
+
+static void
+LockTestHigh(int priority)
+{
+    testSecond->Acquire();
+    ASSERT(kernel->currentThread->priority == priority);
+    testSecond->Release();
+    testDone->V();
+}
+
+void
+Lock::SelfTest()
+{
+    Thread *current = kernel->currentThread;
+    int oldPriority = current->priority;
+    Thread *low, *middle, *high;
+
+    if (!kernel->priorityInheritance)
+	return;
+    ASSERT(lockHolder == NULL);
+    testFirst = this;
+    testSecond = new Lock("inheritance test");
+    testGo = new Semaphore("inheritance go", 0);
+    testDone = new Semaphore("inheritance done", 0);
+    current->priority = 0;
+
+    low = new Thread("low", 1);
+    low->priority = MaxPriority / 4;
+    low->Fork((VoidFunctionPtr) LockTestLow, (void *) low->priority);
+    while (lockHolder != low)		// it takes this lock
+	current->Yield();
+    middle = new Thread("middle", 2);
+    middle->priority = MaxPriority / 2;
+    middle->Fork((VoidFunctionPtr) LockTestMiddle, 
+					(void *) middle->priority);
+    while (middle->waitingFor != this)	// it takes the other, and
+	current->Yield();		// waits for this one
+    ASSERT(low->priority == middle->priority);
+    high = new Thread("high", 3);
+    high->priority = MaxPriority;
+    high->Fork((VoidFunctionPtr) LockTestHigh, (void *) high->priority);
+    while (high->waitingFor != testSecond)	// it waits for the other
+	current->Yield();
+    ASSERT(middle->priority == MaxPriority && low->priority == MaxPriority);
+
+    testGo->V();
+    for (int i = 0; i < 3; i++)
+	testDone->P();
+    ASSERT(lockHolder == NULL && current->ownPriority == -1);
+    current->priority = oldPriority;
+    delete testDone;
+    delete testGo;
+    delete testSecond;
 }
 
 //----------------------------------------------------------------------
@@ -215,7 +541,6 @@ void Lock::Release()
 Condition::Condition(char* debugName)
 {
     name = debugName;
-    waitQueue = new List<Semaphore *>;
 }
 
 //----------------------------------------------------------------------
@@ -225,36 +550,37 @@ Condition::Condition(char* debugName)
 
 Condition::~Condition()
 {
-    delete waitQueue;
 }
 
 //----------------------------------------------------------------------
 // Condition::Wait
-// 	Atomically release monitor lock and go to sleep.
-//	Our implementation uses semaphores to implement this, by
-//	allocating a semaphore for each waiting thread.  The signaller
-//	will V() this semaphore, so there is no chance the waiter
-//	will miss the signal, even though the lock is released before
-//	calling P().
+// 	Atomically release monitor lock and go to sleep.  The thread
+//	goes on this condition's queue before the lock is released, and
+//	interrupts are off throughout, so there is no chance it will 
+//	miss the signal.
 //
 //	Note: we assume Mesa-style semantics, which means that the
-//	waiter must re-acquire the monitor lock when waking up.
+//	waiter must re-acquire the monitor lock when waking up.  The
+//	signaller does that for it, by moving it to the lock's queue;
+//	so it is woken holding the lock.
 //
 //	"conditionLock" -- lock protecting the use of this condition
 //----------------------------------------------------------------------
 
 void Condition::Wait(Lock* conditionLock) 
 {
-     Semaphore *waiter;
+    Interrupt *interrupt = kernel->interrupt;
+    Thread *currentThread = kernel->currentThread;
+    IntStatus oldLevel;
     
-     ASSERT(conditionLock->IsHeldByCurrentThread());
-
-     waiter = new Semaphore("condition", 0);
-     waitQueue->Append(waiter);
-     conditionLock->Release();
-     waiter->P();
-     conditionLock->Acquire();
-     delete waiter;
+    ASSERT(conditionLock->IsHeldByCurrentThread());
+
+    oldLevel = interrupt->SetLevel(IntOff);
+    waitQueue.Append(currentThread);
+    conditionLock->Release();
+    currentThread->Sleep(FALSE);
+    ASSERT(conditionLock->IsHeldByCurrentThread());
+    (void) interrupt->SetLevel(oldLevel);
 }
 
 //----------------------------------------------------------------------
@@ -263,37 +589,57 @@ void Condition::Wait(Lock* conditionLock)
 //
 //	Note: we assume Mesa-style semantics, which means that the
 //	signaller doesn't give up control immediately to the thread
-//	being woken up (unlike Hoare-style).
+//	being woken up (unlike Hoare-style).  The thread just moves
+//	on to the lock's queue, to be handed the lock in its turn.
 //
 //	Also note: we assume the caller holds the monitor lock
 //	(unlike what is described in Birrell's paper).  This allows
-//	us to access waitQueue without disabling interrupts.
+//	us to access waitQueue, and the lock's queue, without 
+//	disabling interrupts.
 //
 //	"conditionLock" -- lock protecting the use of this condition
 //----------------------------------------------------------------------
 
 void Condition::Signal(Lock* conditionLock)
 {
-    Semaphore *waiter;
+    Interrupt *interrupt = kernel->interrupt;
+    Thread *waiter;
+    IntStatus oldLevel;
     
     ASSERT(conditionLock->IsHeldByCurrentThread());
     
-    if (!waitQueue->IsEmpty()) {
-        waiter = waitQueue->RemoveFront();
-	waiter->V();
+    waiter = waitQueue.RemoveFront();
+    if (waiter != NULL) {
+	oldLevel = interrupt->SetLevel(IntOff);	// it may lend its
+	conditionLock->AddWaiter(waiter);	// priority
+	(void) interrupt->SetLevel(oldLevel);
     }
 }
 
 //----------------------------------------------------------------------
 // Condition::Broadcast
-// 	Wake up all threads waiting on this condition, if any.
+// 	Wake up all threads waiting on this condition, if any, by
+//	moving them all to the lock's queue in one go -- unless they
+//	have to lend their priorities, or their waits are traced, when
+//	they are moved one at a time.
 //
 //	"conditionLock" -- lock protecting the use of this condition
 //----------------------------------------------------------------------
 
 void Condition::Broadcast(Lock* conditionLock) 
 {
-    while (!waitQueue->IsEmpty()) {
-        Signal(conditionLock);
+    Interrupt *interrupt = kernel->interrupt;
+    Thread *waiter;
+    IntStatus oldLevel;
+
+    ASSERT(conditionLock->IsHeldByCurrentThread());
+
+    if (kernel->priorityInheritance || DebugIsOn(dbgSynch)) {
+	oldLevel = interrupt->SetLevel(IntOff);
+	while ((waiter = waitQueue.RemoveFront()) != NULL)
+	    conditionLock->AddWaiter(waiter);
+	(void) interrupt->SetLevel(oldLevel);
+    } else {
+	conditionLock->queue.Splice(&waitQueue);
     }
 }
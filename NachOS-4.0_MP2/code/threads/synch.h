@@ -22,12 +22,40 @@
 #include "list.h"
 #include "main.h"
 
+// The following class defines a queue of threads waiting on a
+// synchronization object.  The threads are linked through their own
+// waitNext field, so waiting allocates nothing: a thread blocks on only
+// one thing at a time, so one link each is enough.
+
+class WaitQueue {
+  public:
+    WaitQueue() { first = last = NULL; }
+    
+    bool IsEmpty() { return first == NULL; }
+    void Append(Thread *thread);	// put a thread at the end
+    Thread *RemoveFront();		// take the first thread off; NULL
+					// if there are none
+    void Splice(WaitQueue *other);	// move all of "other"'s threads
+					// onto the end, in one go
+    Thread *Highest();			// the first thread of the highest
+					// priority; NULL if there are none
+    Thread *RemoveHighest();		// take that thread off
+
+  private:
+    Thread *first;			// head of the queue, NULL if empty
+    Thread *last;			// last thread on the queue
+};
+
 // The following class defines a "semaphore" whose value is a non-negative
 // integer.  The semaphore has only two operations P() and V():
 //
 //	P() -- waits until value > 0, then decrement
 //
 //	V() -- increment, waking up a thread waiting in P() if necessary
+//
+// A V() with a thread waiting hands the increment straight to that
+// thread, rather than bumping the value for it to take once it runs, so
+// no other thread can take it first, and the waiter need not check again.
 // 
 // Note that the interface does *not* allow a thread to read the value of 
 // the semaphore directly -- even if you did read the value, the
@@ -50,9 +78,8 @@ class Semaphore {
   private:
     char* name;        // useful for debugging
     int value;         // semaphore value, always >= 0
-    List<Thread *> *queue;     
-		  	// threads waiting in P() for the value to be > 0
-   };
+    WaitQueue queue;   // threads waiting in P() for the value to be > 0
+};
 
 // The following class defines a "lock".  A lock can be BUSY or FREE.
 // There are only two operations allowed on a lock: 
@@ -65,6 +92,20 @@ class Semaphore {
 // In addition, by convention, only the thread that acquired the lock
 // may release it.  As with semaphores, you can't read the lock value
 // (because the value might change immediately after you read it).  
+//
+// As with semaphores, Release() hands the lock straight to the first
+// waiting thread, if there is one, so the lock is never free while
+// anyone is waiting for it.
+//
+// With the priority scheduler, locks also have priority inheritance
+// (unless -noinherit), so that a low priority thread holding a lock
+// can't keep a high priority one waiting for it behind threads of
+// middling priority.  A thread waiting for a lock lends its priority
+// to the holder, if that is lower -- and on to whoever the holder is
+// itself waiting for, and so on.  The holder keeps the priority until
+// it releases the lock, when it drops back to the highest of its own 
+// and those of the threads waiting for the locks it still holds.  The
+// lock goes to the highest priority thread waiting for it.
 
 class Lock {
   public:
@@ -74,6 +115,7 @@ class Lock {
 
     void Acquire(); 		// these are the only operations on a lock
     void Release(); 		// they are both *atomic*
+    void SelfTest();		// test priority inheritance
 
     bool IsHeldByCurrentThread() { 
     		return lockHolder == kernel->currentThread; }
@@ -85,7 +127,22 @@ class Lock {
   private:
     char *name;			// debugging assist
     Thread *lockHolder;		// thread currently holding lock
-    Semaphore *semaphore;	// we use a semaphore to implement lock
+    int heldSince;		// when it took the lock
+    WaitQueue queue;		// threads waiting in Acquire()
+    Lock *nextHeld;		// the next lock lockHolder holds, if
+				// priorities are inherited
+
+    void Take(Thread *thread);	// make "thread" the lock holder
+    void AddWaiter(Thread *thread);
+				// queue "thread" to be handed the lock
+    void LendPriority(Thread *thread);
+				// raise the holder to "thread"'s priority,
+				// and whoever it waits for in turn
+    static void TakeBackPriority(Thread *thread);
+				// drop a holder back to the highest 
+				// priority still lent it
+
+    friend class Condition;	// which queues its waiters here
 };
 
 // The following class defines a "condition variable".  A condition
@@ -120,6 +177,12 @@ class Lock {
 // can acquire the lock, and change data structures, before the woken
 // thread gets a chance to run.  The advantage to Mesa-style semantics
 // is that it is a lot easier to implement than Hoare-style.
+//
+// Since a woken thread could do nothing but wait for the lock, which 
+// the signaller holds, Signal() and Broadcast() don't make it ready at
+// all: they move it to the lock's queue, to be handed the lock in turn
+// (Broadcast() moves them all at once).  So Wait() returns holding the
+// lock, without going back to sleep for it.
 
 class Condition {
   public:
@@ -139,6 +202,6 @@ class Condition {
 
   private:
     char* name;
-    List<Semaphore *> *waitQueue;	// list of waiting threads
+    WaitQueue waitQueue;		// threads waiting to be signalled
 };
 #endif // SYNCH_H
@@ -128,3 +128,48 @@ SynchList<T>::SelfTest(T val)
     }
     delete selfTestPing;
 }
+
+//----------------------------------------------------------------------
+// SynchList<T>::Benchmark, BenchmarkHelper
+//	Time the locks and condition variables under contention: put
+//	"numValues" numbers on the list, and fork "numThreads" threads
+//	that each take one off and put it back "numItems" times; then
+//	wait for them all to finish.  The fewer numbers there are, the
+//	more of the threads wait for one at a time.
+//
+//	The numbers are all different, as List::Append insists, and
+//	few, so that the list itself stays cheap.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+SynchList<T>::BenchmarkHelper (void* data) 
+{
+    BenchmarkArgs *args = (BenchmarkArgs *)data;
+
+    for (int i = 0; i < args->numItems; i++)
+	args->list->Append(args->list->RemoveFront());
+}
+
+template <class T>
+void
+SynchList<T>::Benchmark(int numThreads, int numValues, int numItems)
+{
+    BenchmarkArgs args;
+    int startTicks = kernel->stats->totalTicks;
+    double start = HostTime();
+
+    ASSERT(list->IsEmpty());
+    args.list = this;
+    args.numItems = numItems;
+    for (int i = 0; i < numValues; i++)
+	Append((T) i);
+    Thread::ForkAndJoin("passer", numThreads,
+			SynchList<T>::BenchmarkHelper, (void *) &args);
+    for (int i = 0; i < numValues; i++)
+	(void) RemoveFront();
+    cout << "SynchList, " << numThreads << " threads passing " << numValues
+	<< " values on, " << numItems << " times each: " 
+	<< HostTime() - start << " s, " 
+	<< kernel->stats->totalTicks - startTicks << " ticks\n";
+}
@@ -35,6 +35,9 @@ class SynchList {
     void Apply(void (*f)(T)); // apply function to all elements in list
 
     void SelfTest(T value);	// test the SynchList implementation
+    void Benchmark(int numThreads, int numValues, int numItems);
+				// time passing values between threads
+				// (T must be an integer type)
     
   private:
     List<T> *list;		// the list of things
@@ -44,6 +47,13 @@ class SynchList {
     // these are only to assist SelfTest()
     SynchList<T> *selfTestPing;
     static void SelfTestHelper(void* data);
+
+    // and these only to assist Benchmark()
+    struct BenchmarkArgs {
+	SynchList<T> *list;	// where the values are passed on
+	int numItems;		// how many times each thread does it
+    };
+    static void BenchmarkHelper(void* data);
 };
 
 #include "synchlist.cc"
@@ -20,6 +20,7 @@
 #include "thread.h"
 #include "switch.h"
 #include "synch.h"
+#include "hostthread.h"
 #include "sysdep.h"
 
 // this is put at the top of the execution stack, for detecting stack overflows
@@ -31,14 +32,16 @@ const int STACK_FENCEPOST = 0xdedbeef;
 //	Thread::Fork.
 //
 //	"threadName" is an arbitrary string, useful for debugging.
+//	"stackWords" is how big a stack it needs, once forked.
 //----------------------------------------------------------------------
 
-Thread::Thread(char* threadName, int threadID)
+Thread::Thread(char* threadName, int threadID, int stackWords)
 {
 	ID = threadID;
     name = threadName;
     stackTop = NULL;
     stack = NULL;
+    stackSize = stackWords;
     status = JUST_CREATED;
     for (int i = 0; i < MachineStateSize; i++) {
 	machineState[i] = NULL;		// not strictly necessary, since
@@ -46,6 +49,21 @@ Thread::Thread(char* threadName, int threadID)
 					// of machine registers
     }
     space = NULL;
+    host = NULL;
+    cpu = -1;
+    priority = MaxPriority;
+    readyNext = readyPrev = NULL;
+    waitNext = NULL;
+    waitingFor = NULL;
+    waitingSince = 0;
+    locksHeld = NULL;
+    ownPriority = -1;
+    arrivalTime = firstRunTime = -1;
+    readySince = runningSince = agedAt = 0;
+    quantumUsed = waitTicks = runTicks = 0;
+    voluntarySwitches = involuntarySwitches = preemptions = 0;
+    burstTicks = burstLeft = 0;
+    predictedBurst = InitialBurst;
 }
 
 //----------------------------------------------------------------------
@@ -65,7 +83,27 @@ Thread::~Thread()
     DEBUG(dbgThread, "Deleting thread: " << name);
     ASSERT(this != kernel->currentThread);
     if (stack != NULL)
-	DeallocBoundedArray((char *) stack, StackSize * sizeof(int));
+	kernel->threadPool->FreeStack(stack, stackSize);
+    delete host;
+    delete space;			// give back its physical frames
+}
+
+//----------------------------------------------------------------------
+// Thread::operator new, Thread::operator delete
+// 	Allocate and free the memory of Threads through the pool, so
+//	the memory of finished threads is reused.
+//----------------------------------------------------------------------
+
+void *
+Thread::operator new(size_t size)
+{
+    return kernel->threadPool->AllocThread(size);
+}
+
+void
+Thread::operator delete(void *thread)
+{
+    kernel->threadPool->FreeThread(thread);
 }
 
 //----------------------------------------------------------------------
@@ -124,7 +162,7 @@ Thread::CheckOverflow()
 {
     if (stack != NULL) {
 #ifdef HPUX			// Stacks grow upward on the Snakes
-	ASSERT(stack[StackSize - 1] == STACK_FENCEPOST);
+	ASSERT(stack[stackSize - 1] == STACK_FENCEPOST);
 #else
 	ASSERT(*stack == STACK_FENCEPOST);
 #endif
@@ -215,6 +253,41 @@ Thread::Yield ()
     (void) kernel->interrupt->SetLevel(oldLevel);
 }
 
+//----------------------------------------------------------------------
+// Thread::RunOnHost
+// 	Run (*func)(arg), some work done purely on the host -- it must
+//	touch nothing simulated, nor take any simulated time -- and let
+//	any other thread that is ready run in the meantime, as Yield
+//	does.
+//
+//	With -hostthreads, the work runs outside the simulation lock,
+//	in parallel with the threads run meanwhile (see hostthread.h).
+//	Otherwise, it runs before they do.  Either way, the simulation
+//	goes the same.
+//----------------------------------------------------------------------
+
+void
+Thread::RunOnHost(VoidFunctionPtr func, void *arg)
+{
+    Thread *nextThread;
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+    ASSERT(this == kernel->currentThread);
+
+    nextThread = kernel->scheduler->FindNextToRun();
+    if (nextThread == NULL) {		// nothing to do it alongside
+	(*func)(arg);
+    } else {
+	kernel->scheduler->ReadyToRun(this);
+	if (host != NULL)
+	    host->SetWork(func, arg);	// once we've switched
+	else
+	    (*func)(arg);
+	kernel->scheduler->Run(nextThread, FALSE);
+    }
+    (void) kernel->interrupt->SetLevel(oldLevel);
+}
+
 //----------------------------------------------------------------------
 // Thread::Sleep
 // 	Relinquish the CPU, because the current thread has either
@@ -227,7 +300,8 @@ Thread::Yield ()
 //	we have no thread to run.  "Interrupt::Idle" is called
 //	to signify that we should idle the CPU until the next I/O interrupt
 //	occurs (the only thing that could cause a thread to become
-//	ready to run).
+//	ready to run).  With more than one CPU, we switch to the CPU's
+//	idle thread instead, which waits for other CPUs as well.
 //
 //	NOTE: we assume interrupts are already disabled, because it
 //	is called from the synchronization routines which must
@@ -239,6 +313,7 @@ void
 Thread::Sleep (bool finishing)
 {
     Thread *nextThread;
+    int idleSince;
     
     ASSERT(this == kernel->currentThread);
     ASSERT(kernel->interrupt->getLevel() == IntOff);
@@ -247,10 +322,17 @@ Thread::Sleep (bool finishing)
     DEBUG(dbgTraCode, "In Thread::Sleep, Sleeping thread: " << name << ", " << kernel->stats->totalTicks);
 
     status = BLOCKED;
+    idleSince = kernel->stats->totalTicks;
 	//cout << "debug Thread::Sleep " << name << "wait for Idle\n";
     while ((nextThread = kernel->scheduler->FindNextToRun()) == NULL) {
+	if (kernel->cpu->idleThread != NULL) {
+	    nextThread = kernel->cpu->idleThread;
+	    break;
+	}
 		kernel->interrupt->Idle();	// no one to run, wait for an interrupt
 	}    
+    runningSince += kernel->stats->totalTicks - idleSince;
+					// the CPU was idle, not running us
     // returns when it's time for us to run
     kernel->scheduler->Run(nextThread, finishing); 
 }
@@ -299,6 +381,9 @@ PLabelToAddr(void *plabel)
 //		calls (*func)(arg)
 //		calls Thread::Finish
 //
+//	With -hostthreads, there is no stack to set up: the thread gets
+//	a host thread to run on instead, with a stack of its own.
+//
 //	"func" is the procedure to be forked
 //	"arg" is the parameter to be passed to the procedure
 //----------------------------------------------------------------------
@@ -306,34 +391,38 @@ PLabelToAddr(void *plabel)
 void
 Thread::StackAllocate (VoidFunctionPtr func, void *arg)
 {
-    stack = (int *) AllocBoundedArray(StackSize * sizeof(int));
+    if (kernel->hostThreads) {
+	host = new HostThread(func, arg, stackSize * sizeof(int));
+	return;
+    }
+    stack = kernel->threadPool->AllocStack(stackSize);
 
 #ifdef PARISC
     // HP stack works from low addresses to high addresses
     // everyone else works the other way: from high addresses to low addresses
     stackTop = stack + 16;	// HP requires 64-byte frame marker
-    stack[StackSize - 1] = STACK_FENCEPOST;
+    stack[stackSize - 1] = STACK_FENCEPOST;
 #endif
 
 #ifdef SPARC
-    stackTop = stack + StackSize - 96; 	// SPARC stack must contains at 
+    stackTop = stack + stackSize - 96; 	// SPARC stack must contains at 
 					// least 1 activation record 
 					// to start with.
     *stack = STACK_FENCEPOST;
 #endif 
 
 #ifdef PowerPC // RS6000
-    stackTop = stack + StackSize - 16; 	// RS6000 requires 64-byte frame marker
+    stackTop = stack + stackSize - 16; 	// RS6000 requires 64-byte frame marker
     *stack = STACK_FENCEPOST;
 #endif 
 
 #ifdef DECMIPS
-    stackTop = stack + StackSize - 4;	// -4 to be on the safe side!
+    stackTop = stack + stackSize - 4;	// -4 to be on the safe side!
     *stack = STACK_FENCEPOST;
 #endif
 
 #ifdef ALPHA
-    stackTop = stack + StackSize - 8;	// -8 to be on the safe side!
+    stackTop = stack + stackSize - 8;	// -8 to be on the safe side!
     *stack = STACK_FENCEPOST;
 #endif
 
@@ -342,7 +431,7 @@ Thread::StackAllocate (VoidFunctionPtr func, void *arg)
     // the x86 passes the return address on the stack.  In order for SWITCH() 
     // to go to ThreadRoot when we switch to this thread, the return addres 
     // used in SWITCH() must be the starting address of ThreadRoot.
-    stackTop = stack + StackSize - 4;	// -4 to be on the safe side!
+    stackTop = stack + stackSize - 4;	// -4 to be on the safe side!
     *(--stackTop) = (int) ThreadRoot;
     *stack = STACK_FENCEPOST;
 #endif
@@ -397,6 +486,59 @@ Thread::RestoreUserState()
 }
 
 
+// What each thread forked by ForkAndJoin runs, and how it says it's done.
+struct JoinedWork {
+    VoidFunctionPtr func;
+    void *arg;
+    Semaphore *done;
+};
+
+//----------------------------------------------------------------------
+// JoinedThread
+// 	The body of each thread ForkAndJoin forks: do the work, then
+//	let the forking thread know.
+//----------------------------------------------------------------------
+
+static void
+JoinedThread(JoinedWork *work)
+{
+    (*work->func)(work->arg);
+    work->done->V();
+}
+
+//----------------------------------------------------------------------
+// Thread::ForkAndJoin
+// 	Fork "numThreads" threads, each to run (*func)(arg), and wait
+//	until they have all finished.  The calling thread sleeps on a
+//	semaphore meanwhile, rather than yielding over and over, so it
+//	adds no context switches of its own.  Used by the benchmarks.
+//
+//	"name" is the name of the threads.
+//	"priorities", if not NULL, is the priority to give each one.
+//----------------------------------------------------------------------
+
+void
+Thread::ForkAndJoin(char *name, int numThreads, VoidFunctionPtr func,
+					void *arg, int *priorities)
+{
+    Semaphore *done = new Semaphore("joined", 0);
+    JoinedWork work;
+    Thread *thread;
+
+    work.func = func;
+    work.arg = arg;
+    work.done = done;
+    for (int i = 0; i < numThreads; i++) {
+	thread = new Thread(name, i);
+	if (priorities != NULL)
+	    thread->priority = priorities[i];
+	thread->Fork((VoidFunctionPtr) JoinedThread, (void *) &work);
+    }
+    for (int i = 0; i < numThreads; i++)
+	done->P();
+    delete done;
+}
+
 //----------------------------------------------------------------------
 // SimpleThread
 // 	Loop 5 times, yielding the CPU to another ready thread 
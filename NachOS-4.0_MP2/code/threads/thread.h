@@ -61,6 +61,12 @@ const int StackSize = (8 * 1024);	// in words
 // Thread state
 enum ThreadStatus { JUST_CREATED, RUNNING, READY, BLOCKED, ZOMBIE };
 
+// Thread priorities, for the schedulers that use them; higher numbers
+// are more urgent.  Threads start out at the top.
+const int MaxPriority = 149;
+
+class Lock;
+class HostThread;
 
 // The following class defines a "thread control block" -- which
 // represents a single thread of execution.
@@ -81,12 +87,17 @@ class Thread {
     void *machineState[MachineStateSize];  // all registers except for stackTop
 
   public:
-    Thread(char* debugName, int threadID);		// initialize a Thread 
+    Thread(char* debugName, int threadID, int stackWords = StackSize);
+					// initialize a Thread, to run on a
+					// stack of "stackWords" words
     ~Thread(); 				// deallocate a Thread
 					// NOTE -- thread being deleted
 					// must not be running when delete 
 					// is called
 
+    void *operator new(size_t size);	// Threads, and their stacks, are
+    void operator delete(void *thread);	// recycled (see threadpool.h)
+
     // basic thread operations
 
     void Fork(VoidFunctionPtr func, void *arg); 
@@ -95,6 +106,15 @@ class Thread {
 				// other thread is runnable
     void Sleep(bool finishing); // Put the thread to sleep and 
 				// relinquish the processor
+    void RunOnHost(VoidFunctionPtr func, void *arg);
+				// Run (*func)(arg), which touches
+				// nothing simulated, letting other
+				// threads run meanwhile
+    static void ForkAndJoin(char *name, int numThreads,
+			VoidFunctionPtr func, void *arg,
+			int *priorities = NULL);
+				// Run (*func)(arg) on "numThreads"
+				// new threads, and wait for them all
     void Begin();		// Startup code for the thread	
     void Finish();  		// The thread is done executing
     
@@ -113,12 +133,15 @@ class Thread {
     int *stack; 	 	// Bottom of the stack 
 				// NULL if this is the main thread
 				// (If NULL, don't deallocate stack)
+    int stackSize;		// in words
     ThreadStatus status;	// ready, running or blocked
     char* name;
 	int   ID;
     void StackAllocate(VoidFunctionPtr func, void *arg);
     				// Allocate a stack for thread.
 				// Used internally by Fork()
+    friend class Cpu;		// ... and to start idle threads, which
+				// are never put on the ready list
 
 // A thread running a user program actually has *two* sets of CPU registers -- 
 // one for its state while executing user code, one for its state 
@@ -131,6 +154,47 @@ class Thread {
     void RestoreUserState();		// restore user-level register state
 
     AddrSpace *space;			// User code this thread is running.
+    HostThread *host;			// host thread it runs on, with
+					// -hostthreads; NULL otherwise
+    int cpu;				// CPU it last ran on, whose ready 
+					// list it goes back to; -1 if it
+					// hasn't run yet
+    int priority;			// 0 to MaxPriority
+    Thread *readyNext;			// links on a RunQueue (see
+    Thread *readyPrev;			// scheduler.h)
+    Thread *waitNext;			// link on a WaitQueue, while blocked
+					// (see synch.h)
+
+    // Priority inheritance (see synch.h)
+    Lock *waitingFor;			// lock it is blocked in Acquire on;
+					// NULL if none
+    int waitingSince;			// when it started waiting for it
+    Lock *locksHeld;			// locks it holds, linked through
+					// Lock::nextHeld
+    int ownPriority;			// its priority before threads waiting
+					// for its locks lent it theirs; -1
+					// if it hasn't been lent any
+
+    // What the scheduler keeps track of, in ticks of simulated time
+    int arrivalTime;			// when first made ready; -1 if not
+					// yet (or if it never was: "main")
+    int firstRunTime;			// when first run
+    int readySince;			// when last made ready
+    int runningSince;			// when last dispatched
+    int agedAt;				// when its priority last aged
+    int quantumUsed;			// time run at its present level
+    int waitTicks;			// time spent ready, but not running
+    int runTicks;			// time spent running
+    int voluntarySwitches;		// times it gave up the CPU itself
+    int involuntarySwitches;		// times an interrupt handler made
+					// it yield, of which
+    int preemptions;			// ... before its time slice was up
+    int burstTicks;			// time run in its present CPU burst
+					// (since it last blocked)
+    int predictedBurst;			// how long that burst is expected
+					// to be
+    int burstLeft;			// how much of it was expected to be
+					// left, when last made ready
 };
 
 // external function, dummy routine whose sole job is to call Thread::Print
@@ -0,0 +1,216 @@
+// threadpool.cc
+//	Routines to keep the stacks and Thread objects of finished
+//	threads, for new threads to reuse.
+//
+//	What is kept is linked into free lists through its own memory,
+//	so keeping and reusing it allocates nothing.  A stack keeps its
+//	guard pages while it is on a free list; they are only unmapped
+//	again when it is freed for good.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "threadpool.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// ThreadPool::ThreadPool
+// 	Initialize an empty pool.
+//
+//	"limit" -- the most stacks, and the most Threads, to keep; 0 to
+//		free everything straight away
+//----------------------------------------------------------------------
+
+ThreadPool::ThreadPool(int limit)
+{
+    this->limit = limit;
+    for (int c = 0; c < NumStackClasses; c++)
+	freeStacks[c] = NULL;
+    stacksKept = 0;
+    freeThreads = NULL;
+    threadsKept = 0;
+    stacksReused = 0;
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::~ThreadPool
+// 	Free everything being kept.
+//----------------------------------------------------------------------
+
+ThreadPool::~ThreadPool()
+{
+    SetLimit(0);
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::SetLimit
+// 	Change how many stacks, and Threads, are kept, freeing any
+//	there are too many of now.
+//----------------------------------------------------------------------
+
+void
+ThreadPool::SetLimit(int limit)
+{
+    int *stack;
+    void *thread;
+
+    this->limit = limit;
+    for (int c = NumStackClasses - 1; c >= 0 && stacksKept > limit; c--) {
+	while (freeStacks[c] != NULL && stacksKept > limit) {
+	    stack = freeStacks[c];
+	    freeStacks[c] = *(int **) stack;
+	    DeallocBoundedArray((char *) stack, ClassSize(c) * sizeof(int));
+	    stacksKept--;
+	}
+    }
+    while (threadsKept > limit) {
+	thread = freeThreads;
+	freeThreads = *(void **) thread;
+	::operator delete(thread);
+	threadsKept--;
+    }
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::StackClass
+// 	Return which class of stack a thread needing "size" words gets:
+//	the smallest big enough, or -1 if none is.
+//----------------------------------------------------------------------
+
+int
+ThreadPool::StackClass(int size)
+{
+    for (int c = 0; c < NumStackClasses; c++) {
+	if (size <= ClassSize(c))
+	    return c;
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::AllocStack
+// 	Return a stack of at least "size" words, with guard pages: one
+//	that has been kept, if there is one of the right class, or else
+//	a new one.
+//----------------------------------------------------------------------
+
+int *
+ThreadPool::AllocStack(int size)
+{
+    int c = StackClass(size);
+    int *stack;
+
+    if (c == -1)			// too big to have been kept
+	return (int *) AllocBoundedArray(size * sizeof(int));
+    if (freeStacks[c] == NULL)
+	return (int *) AllocBoundedArray(ClassSize(c) * sizeof(int));
+    stacksReused++;
+    stack = freeStacks[c];
+    freeStacks[c] = *(int **) stack;
+    stacksKept--;
+    return stack;
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::FreeStack
+// 	Take back a stack from a thread that has finished with it.
+//	Keep it, if there is room; otherwise free it.
+//
+//	"size" -- the number of words it was asked for with
+//----------------------------------------------------------------------
+
+void
+ThreadPool::FreeStack(int *stack, int size)
+{
+    int c = StackClass(size);
+
+    if (c == -1) {
+	DeallocBoundedArray((char *) stack, size * sizeof(int));
+    } else if (stacksKept >= limit) {
+	DeallocBoundedArray((char *) stack, ClassSize(c) * sizeof(int));
+    } else {
+	*(int **) stack = freeStacks[c];
+	freeStacks[c] = stack;
+	stacksKept++;
+    }
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::AllocThread
+// 	Return memory for a new Thread: that of one that has been
+//	deleted, if any has been kept, or else some newly allocated.
+//	Called by Thread::operator new.
+//----------------------------------------------------------------------
+
+void *
+ThreadPool::AllocThread(int size)
+{
+    void *thread;
+
+    ASSERT(size == sizeof(Thread));
+    if (freeThreads == NULL)
+	return ::operator new(size);
+    thread = freeThreads;
+    freeThreads = *(void **) thread;
+    threadsKept--;
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::FreeThread
+// 	Take back the memory of a deleted Thread.  Keep it, if there is
+//	room; otherwise free it.  Called by Thread::operator delete.
+//----------------------------------------------------------------------
+
+void
+ThreadPool::FreeThread(void *thread)
+{
+    if (threadsKept >= limit) {
+	::operator delete(thread);
+    } else {
+	*(void **) thread = freeThreads;
+	freeThreads = thread;
+	threadsKept++;
+    }
+}
+
+//----------------------------------------------------------------------
+// PoolThread
+// 	The body of each thread the benchmark forks: finish at once.
+//----------------------------------------------------------------------
+
+static void
+PoolThread(void *arg)
+{
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::Benchmark
+// 	Time creating and finishing "numThreads" kernel threads that do
+//	nothing, "batch" of them at a time -- first with nothing kept,
+//	as if there were no pool, and then with the pool.
+//----------------------------------------------------------------------
+
+void
+ThreadPool::Benchmark(int numThreads, int batch)
+{
+    int oldLimit = limit;
+    int reused = 0;
+    double start, times[2];
+
+    for (int pass = 0; pass < 2; pass++) {
+	SetLimit((pass == 0) ? 0 : oldLimit);
+	reused = stacksReused;
+	start = HostTime();
+	for (int i = 0; i < numThreads; i += batch)
+	    Thread::ForkAndJoin("pooled", batch, PoolThread, NULL);
+	times[pass] = HostTime() - start;
+	reused = stacksReused - reused;
+    }
+    cout << "Fork and finish, " << numThreads << " threads, " << batch
+	<< " at a time: " << times[0] << " s without the pool, "
+	<< times[1] << " s with it, keeping " << oldLimit << " (" 
+	<< reused << " stacks reused)\n";
+}
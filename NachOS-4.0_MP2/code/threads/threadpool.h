@@ -0,0 +1,64 @@
+// threadpool.h
+//	Data structures for recycling the memory threads are made of.
+//
+//	Creating a thread allocates a Thread, and an execution stack
+//	with an unmapped page either side of it (see AllocBoundedArray),
+//	which takes two mprotect system calls; the thread finishing
+//	frees them both again, with two more.  A ThreadPool keeps what
+//	finished threads give back, guard pages and all, for the next
+//	threads to be created to use instead.
+//
+//	Stacks come in size classes, the first StackSize words, and each
+//	twice the one before.  A thread gets a stack of the smallest
+//	class that is big enough for it; stacks bigger than the largest
+//	class are not kept.  No more than "limit" stacks, nor "limit"
+//	Thread objects, are kept at a time; past that, they are freed.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "thread.h"
+
+const int NumStackClasses = 3;	// StackSize, twice that, and 4 times
+const int DefaultPoolLimit = 32;
+
+class ThreadPool {
+  public:
+    ThreadPool(int limit);	// Keep up to "limit" of each; 0 to
+				// keep nothing
+    ~ThreadPool();		// Free everything being kept
+
+    int *AllocStack(int size);	// A stack of "size" words (at least)
+    void FreeStack(int *stack, int size);
+				// Give back a stack AllocStack returned
+    int StackClass(int size);	// Which class a stack of "size" words
+				// comes from; -1 if too big for any
+    int ClassSize(int c) { return StackSize << c; }
+
+    void *AllocThread(int size);// Memory for a Thread, of "size" bytes
+    void FreeThread(void *thread);
+				// Give back memory AllocThread returned
+
+    void SetLimit(int limit);	// Change how much is kept
+    void Benchmark(int numThreads, int batch);
+				// Time forking threads, with the pool
+				// and without
+
+  private:
+    int limit;			// most stacks, and Threads, kept
+    int *freeStacks[NumStackClasses];	// stacks kept, linked through
+				// their first word
+    int stacksKept;		// how many, in all the classes
+    void *freeThreads;		// Threads kept, linked likewise
+    int threadsKept;
+
+    int stacksReused;		// how often a kept stack was reused
+};
+
+#endif // THREADPOOL_H
@@ -19,7 +19,31 @@
 #include "main.h"
 #include "addrspace.h"
 #include "machine.h"
-#include "noff.h"
+#include "coremap.h"
+#include "profile.h"
+
+// If the machine has a TLB, each CPU keeps track of the address space
+// whose page table entries are loaded in it (Cpu::tlbOwner).  The TLB
+// is only flushed when a different address space is restored, so 
+// switching to a kernel thread and back doesn't cost a TLB's worth of
+// misses.
+
+// The code pages of an executable, mapped read-only into every address
+// space running it, so that running a program several times reads and
+// stores its code only once.  Only pages holding nothing but code are
+// shared; a page the code shares with data is private as usual.
+
+class SharedText {
+  public:
+    char *fileName;		// the executable
+    int firstPage;		// first virtual page holding only code
+    int numPages;		// number of such pages
+    int *frames;		// frame holding each page; -1 until loaded
+    bool *filled;		// has the page been read in yet?
+    int refCount;		// number of address spaces using them
+};
+
+static List<SharedText *> *sharedTexts = NULL;
 
 //----------------------------------------------------------------------
 // SwapHeader
@@ -74,6 +98,88 @@ AddrSpace::AddrSpace()
         pageTable[i].dirty = FALSE;
         pageTable[i].readOnly = FALSE;
     }
+    numPages = 0;
+    text = NULL;
+    fileName = NULL;
+    executable = NULL;
+    swapSlot = NULL;
+    numFrames = maxFrames = 0;
+    numFaults = 0;
+    loadTime = 0.0;
+    startTick = 0;
+    profile = NULL;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AddrSpace
+// 	Create a copy of "parent", for a Fork.  No page is copied: every
+//	page the parent has in memory is mapped into both address
+//	spaces, read-only, and whichever of them writes to it first gets
+//	a copy of its own (see CopyOnWrite).  Pages the parent hasn't
+//	touched yet are read in from the executable as usual, and pages
+//	it has in swap are copied there.
+//
+//	Shared code pages are really read-only, and are just shared.
+//----------------------------------------------------------------------
+
+AddrSpace::AddrSpace(AddrSpace *parent)
+{
+    CoreMap *coreMap = kernel->coreMap;
+
+    loadTime = HostTime();
+    numPages = parent->numPages;
+    noffH = parent->noffH;
+    fileName = new char[strlen(parent->fileName) + 1];
+    strcpy(fileName, parent->fileName);
+    executable = kernel->fileSystem->Open(fileName);
+    ASSERT(executable != NULL);
+    text = parent->text;
+    if (text != NULL)
+	text->refCount++;
+    swapSlot = NULL;
+    numFrames = maxFrames = 0;
+    numFaults = 0;
+    startTick = kernel->stats->totalTicks;
+    profile = NULL;			// only the program as Exec'd is profiled
+
+    if (coreMap != NULL) {
+	coreMap->Acquire();
+	swapSlot = new int[numPages];
+    }
+
+    // The parent's pages are about to become read-only, so no TLB
+    // can keep the writable copies it has of them.
+    parent->DropTLBEntry(-1);
+
+    pageTable = new TranslationEntry[numPages];
+    for (int i = 0; i < numPages; i++) {
+	TranslationEntry *from = &parent->pageTable[i];
+	TranslationEntry *to = &pageTable[i];
+
+	*to = *from;
+	to->use = FALSE;
+	if (swapSlot != NULL)
+	    swapSlot[i] = -1;
+	if (IsShared(i))
+	    continue;
+	if (from->valid) {		// share the frame until one writes
+	    if (coreMap != NULL)
+		coreMap->Share(from->physicalPage);
+	    else
+		kernel->frameAllocator->Share(from->physicalPage);
+	    from->readOnly = TRUE;
+	    to->readOnly = TRUE;
+	} else {			// fill in our own on first touch
+	    to->physicalPage = -1;
+	    if (swapSlot != NULL && parent->swapSlot[i] != -1)
+		swapSlot[i] = coreMap->CopySwap(parent->swapSlot[i]);
+	}
+    }
+    kernel->machine->InvalidateTranslations();
+
+    if (coreMap != NULL)
+	coreMap->Release();
+    loadTime = HostTime() - loadTime;
 }
 
 //----------------------------------------------------------------------
@@ -85,12 +191,38 @@ AddrSpace::~AddrSpace()
 {
     for (int i = 0; i < numPages; i++)
     {
-        if (pageTable[i].physicalPage != -1)
+        if (pageTable[i].physicalPage != -1 && !IsShared(i))
         {
-            kernel->availFrameTable[pageTable[i].physicalPage] = 0;
+            if (kernel->coreMap != NULL)
+                kernel->coreMap->Free(pageTable[i].physicalPage);
+            else
+                kernel->frameAllocator->Free(pageTable[i].physicalPage);
         }
+        if (swapSlot != NULL && swapSlot[i] != -1)
+            kernel->coreMap->FreeSwap(swapSlot[i]);
+    }
+    for (int i = 0; i < kernel->numCpus; i++) {
+	Cpu *cpu = kernel->cpus[i];
+
+	if (cpu->tlbOwner == this) {	// the entries are no longer any good
+	    cpu->machine->FlushTLB();
+	    cpu->tlbOwner = NULL;
+	}
     }
-    delete pageTable;
+    if (text != NULL)
+        DetachText();
+    ASSERT(numFrames == 0);
+    DEBUG(dbgAddr, "Address space used at most " << maxFrames << " frames, "
+		<< numFaults << " page faults; load took " << loadTime * 1e6
+		<< " us, ran " << kernel->stats->totalTicks - startTick
+		<< " ticks");
+    if (kernel->machine->profile == profile)
+	kernel->machine->profile = NULL;
+    delete profile;			// reports on the run
+    delete [] pageTable;
+    delete [] swapSlot;
+    delete executable;
+    delete [] fileName;
 }
 
 //----------------------------------------------------------------------
@@ -105,10 +237,12 @@ AddrSpace::~AddrSpace()
 
 bool AddrSpace::Load(char *fileName)
 {
-    OpenFile *executable = kernel->fileSystem->Open(fileName);
-    NoffHeader noffH;
+    OpenFile *executable;
     unsigned int size;
 
+    loadTime = HostTime();
+    executable = kernel->fileSystem->Open(fileName);
+
     if (executable == NULL)
     {
         cerr << "Unable to open file " << fileName << "\n";
@@ -137,6 +271,41 @@ bool AddrSpace::Load(char *fileName)
 
     //DEBUG(dbgAddr, "Initializing address space: " << numPages << ", " << size);
 
+    this->fileName = new char[strlen(fileName) + 1];
+    strcpy(this->fileName, fileName);
+    this->executable = executable;
+    AttachText(fileName);
+    if (kernel->profileInterval > 0)
+	profile = new Profile(fileName, kernel->profileInterval);
+
+    if (kernel->coreMap != NULL)
+    {
+        // Demand paging: nothing is read in yet.  Every page starts
+        // out invalid, and PageIn fetches it from the executable (or
+        // zero fills it) the first time it is touched.
+        if (numPages > kernel->coreMap->SwapSize())
+        {
+            kernel->interrupt->setStatus(SystemMode);
+            ExceptionHandler(MemoryLimitException);
+            kernel->interrupt->setStatus(UserMode);
+        }
+        delete [] pageTable;
+        pageTable = new TranslationEntry[numPages];
+        swapSlot = new int[numPages];
+        for (int i = 0; i < numPages; i++)
+        {
+            pageTable[i].virtualPage = i;
+            pageTable[i].physicalPage = -1;
+            pageTable[i].valid = FALSE;
+            pageTable[i].use = FALSE;
+            pageTable[i].dirty = FALSE;
+            pageTable[i].readOnly = IsShared(i);
+            swapSlot[i] = -1;
+        }
+        loadTime = HostTime() - loadTime;
+        return TRUE;                    // keep the file open for PageIn
+    }
+
     // if (numPages > NumPhysPages)
     // {
     //     kernel->interrupt->setStatus(SystemMode);
@@ -144,141 +313,172 @@ bool AddrSpace::Load(char *fileName)
     //     kernel->interrupt->setStatus(UserMode);
     // }
 
+    // Reserve frames, but read nothing in yet: PageIn fills each page
+    // from the executable, or with zeros, the first time it is
+    // touched.  Shared code pages use the frames set aside for them
+    // by whoever ran the program first; reserve any that aren't yet
+    // before the private pages, so a program's frames are in address
+    // order when memory is empty.
     for (int i = 0; i < numPages; i++)
     {
-        int frame = kernel->allocateFrame();
-        if (frame == -1)
+        if (IsShared(i) && SharedFrame(i, FALSE) == -1)
         {
             kernel->interrupt->setStatus(SystemMode);
             ExceptionHandler(MemoryLimitException);
             kernel->interrupt->setStatus(UserMode);
         }
-        pageTable[i].physicalPage = frame;
-        pageTable[i].valid = TRUE;
-        bzero(kernel->machine->mainMemory + frame * PageSize, PageSize);
     }
 
-    unsigned int physical_address;
-
-    // if (noffH.code.size > 0)
-    // {
-
-    //     // DEBUG(dbgAddr, "Initializing code segment.");
-    //     // DEBUG(dbgAddr, physical_address << ", " << noffH.code.size);
-
-    //     ExceptionType result = Translate(noffH.code.virtualAddr, &physical_address, 1);
-    //     if (result != NoException)
-    //     {
-    //         kernel->interrupt->setStatus(SystemMode);
-    //         ExceptionHandler(result);
-    //         kernel->interrupt->setStatus(UserMode);
-    //     }
-    //     executable->ReadAt(
-    //         &(kernel->machine->mainMemory[physical_address]),
-    //         noffH.code.size, noffH.code.inFileAddr);
-    // }
+    // Prefer frames in one run for the private pages; if memory is
+    // too fragmented for that, take whatever frames are free.
+    int numPrivate = numPages - (text != NULL ? text->numPages : 0);
+    int first = (numPrivate > 0) ?
+                    kernel->frameAllocator->AllocateRun(this, numPrivate) : -1;
 
-    // if (noffH.initData.size > 0)
-    // {
-    //     // DEBUG(dbgAddr, "Initializing data segment.");
-    //     // DEBUG(dbgAddr, physical_address << ", " << noffH.initData.size);
-
-    //     ExceptionType result = Translate(noffH.initData.virtualAddr, &physical_address, 1);
-    //     if (result != NoException)
-    //     {
-    //         kernel->interrupt->setStatus(SystemMode);
-    //         ExceptionHandler(result);
-    //         kernel->interrupt->setStatus(UserMode);
-    //     }
-    //     executable->ReadAt(
-    //         &(kernel->machine->mainMemory[physical_address]),
-    //         noffH.initData.size, noffH.initData.inFileAddr);
-    // }
-    //unsigned int physical_address;
-    if (noffH.code.size > 0)
+    for (int i = 0; i < numPages; i++)
     {
-        DEBUG(dbgAddr, "Initializing code segment.");
-        DEBUG(dbgAddr, noffH.code.virtualAddr << ", " << noffH.code.size);
+        int frame;
 
-        for (int capacity = noffH.code.size, offset = 0; capacity > 0; capacity -= PageSize, offset += PageSize)
+        if (IsShared(i))
         {
-            unsigned int loadsize;
-            if (capacity < PageSize)
-            {
-                loadsize = capacity;
-            }
-            else
-            {
-                loadsize = PageSize;
-            }
-            // translate : virtual address,physical address, int isReadWrite
-            ExceptionType result = Translate(noffH.code.virtualAddr + offset, &physical_address, 1);
-            // get physcial address
-            DEBUG(dbgAddr, physical_address << "\n");
-            if (result != NoException)
-            {
-                kernel->interrupt->setStatus(SystemMode);
-                ExceptionHandler(result);
-                kernel->interrupt->setStatus(UserMode);
-            }
-            executable->ReadAt(
-                &(kernel->machine->mainMemory[physical_address]),
-                loadsize, noffH.code.inFileAddr + offset);
+            frame = SharedFrame(i, FALSE);
         }
-    }
-    if (noffH.initData.size > 0)
-    {
-        DEBUG(dbgAddr, "Initializing data segment.");
-        DEBUG(dbgAddr, noffH.initData.virtualAddr << ", " << noffH.initData.size);
-        for (int capacity = noffH.initData.size, offset = 0; capacity > 0; capacity -= PageSize, offset += PageSize)
+        else
         {
-            unsigned int loadsize;
-            if (capacity < PageSize)
-            {
-                loadsize = capacity;
-            }
-            else
-            {
-                loadsize = PageSize;
-            }
-            // translate : virtual address,physical address, int isReadWrite
-            ExceptionType result = Translate(noffH.initData.virtualAddr + offset, &physical_address, 1);
-            // get physcial address
-            DEBUG(dbgAddr, physical_address << "\n");
-            if (result != NoException)
-            {
-                kernel->interrupt->setStatus(SystemMode);
-                ExceptionHandler(result);
-                kernel->interrupt->setStatus(UserMode);
-            }
-            executable->ReadAt(
-                &(kernel->machine->mainMemory[physical_address]),
-                loadsize, noffH.initData.inFileAddr + offset);
+            frame = (first != -1) ? first++ :
+                        kernel->frameAllocator->Allocate(this);
         }
-    }
-#ifdef RDATA
-    unsigned int readonlyPhysicalAddr;
-    if (noffH.readonlyData.size > 0)
-    {
-        DEBUG(dbgAddr, "Initializing read only data segment.");
-        DEBUG(dbgAddr, readonlyPhysicalAddr << ", " << noffH.readonlyData.size);
-
-        ExceptionType result = Translate(noffH.readonlyData.virtualAddr, &readonlyPhysicalAddr, 0);
-        if (result != NoException)
+        if (frame == -1)
         {
             kernel->interrupt->setStatus(SystemMode);
-            ExceptionHandler(result);
+            ExceptionHandler(MemoryLimitException);
             kernel->interrupt->setStatus(UserMode);
         }
+        pageTable[i].physicalPage = frame;
+        pageTable[i].valid = FALSE;
+        pageTable[i].readOnly = IsShared(i);
+    }
+
+    loadTime = HostTime() - loadTime;
+    return TRUE;                        // keep the file open for PageIn
+}
 
-        executable->ReadAt(
-            &(kernel->machine->mainMemory[readonlyPhysicalAddr]),
-            noffH.readonlyData.size, noffH.readonlyData.inFileAddr);
+//----------------------------------------------------------------------
+// AddrSpace::AttachText
+// 	Find the shared code pages of "fileName", creating an entry for
+//	them if no other address space is running the program, and add
+//	this address space to its users.  Called by Load once the
+//	NOFF header has been read.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::AttachText(char *fileName)
+{
+    int firstPage = divRoundUp(noffH.code.virtualAddr, PageSize);
+    int endPage = (noffH.code.virtualAddr + noffH.code.size) / PageSize;
+
+    if (endPage <= firstPage)		// no page holds only code
+	return;
+    if (sharedTexts == NULL)
+	sharedTexts = new List<SharedText *>;
+
+    ListIterator<SharedText *> iter(sharedTexts);
+    for (; !iter.IsDone(); iter.Next()) {
+	if (strcmp(iter.Item()->fileName, fileName) == 0) {
+	    text = iter.Item();
+	    ASSERT(text->firstPage == firstPage);
+	    ASSERT(text->numPages == endPage - firstPage);
+	    text->refCount++;
+	    DEBUG(dbgAddr, "Sharing " << text->numPages << " code pages of "
+				<< fileName);
+	    return;
+	}
     }
-#endif
 
-    delete executable; // close file
-    return TRUE;       // success
+    text = new SharedText;
+    text->fileName = new char[strlen(fileName) + 1];
+    strcpy(text->fileName, fileName);
+    text->firstPage = firstPage;
+    text->numPages = endPage - firstPage;
+    text->frames = new int[text->numPages];
+    text->filled = new bool[text->numPages];
+    for (int i = 0; i < text->numPages; i++) {
+	text->frames[i] = -1;
+	text->filled[i] = FALSE;
+    }
+    text->refCount = 1;
+    sharedTexts->Append(text);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::DetachText
+// 	This address space is done with its shared code pages.  When
+//	the last user of them goes, free their frames.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::DetachText()
+{
+    ASSERT(text->refCount > 0);
+    if (--text->refCount == 0) {
+	for (int i = 0; i < text->numPages; i++) {
+	    if (text->frames[i] != -1)
+		kernel->frameAllocator->Free(text->frames[i]);
+	}
+	sharedTexts->Remove(text);
+	delete [] text->frames;
+	delete [] text->filled;
+	delete [] text->fileName;
+	delete text;
+    }
+    text = NULL;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::IsShared
+// 	Is virtual page "vpn" one of the shared code pages?
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::IsShared(int vpn)
+{
+    return text != NULL && vpn >= text->firstPage &&
+		vpn < text->firstPage + text->numPages;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::SharedFrame
+// 	Return the frame holding shared code page "vpn", setting one
+//	aside if no address space has needed the page yet, and if "fill"
+//	is set, reading the page in if nobody has touched it yet.  The
+//	frame belongs to the shared copy rather than to any address
+//	space, and is never paged out.
+//
+//	Returns -1 if there is no free frame for it.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::SharedFrame(int vpn, bool fill)
+{
+    int i = vpn - text->firstPage;
+    int frame = text->frames[i];
+
+    if (frame == -1) {
+	if (kernel->coreMap != NULL)
+	    frame = kernel->coreMap->Allocate(NULL, vpn, NULL);
+	else
+	    frame = kernel->frameAllocator->Allocate(NULL);
+	if (frame == -1)
+	    return -1;
+	text->frames[i] = frame;
+    }
+    if (fill && !text->filled[i]) {
+	DEBUG(dbgAddr, "Loading shared code page " << vpn << " into frame "
+			<< frame);
+	FillPage(vpn, frame);
+	text->filled[i] = TRUE;
+    }
+    return frame;
 }
 
 //----------------------------------------------------------------------
@@ -294,6 +494,7 @@ void AddrSpace::Execute(char *fileName)
 {
 
     kernel->currentThread->space = this;
+    startTick = kernel->stats->totalTicks;
 
     this->InitRegisters(); // set the initial register values
     this->RestoreState();  // load page table register
@@ -345,11 +546,22 @@ void AddrSpace::InitRegisters()
 // 	On a context switch, save any machine state, specific
 //	to this address space, that needs saving.
 //
-//	For now, don't need to save anything!
+//	If there is a TLB, the hardware has been setting the use and
+//	dirty bits in its copies of our page table entries; merge them
+//	back into the page table.
 //----------------------------------------------------------------------
 
 void AddrSpace::SaveState()
 {
+    Machine *machine = kernel->machine;
+
+    if (machine->tlb != NULL && kernel->cpu->tlbOwner == this) {
+					// keep what the TLB recorded
+	for (int i = 0; i < machine->tlbSize; i++) {
+	    if (machine->tlb[i].valid)
+		MergeTLBEntry(&machine->tlb[i]);
+	}
+    }
 }
 
 //----------------------------------------------------------------------
@@ -357,13 +569,496 @@ void AddrSpace::SaveState()
 // 	On a context switch, restore the machine state so that
 //	this address space can run.
 //
-//      For now, tell the machine where to find the page table.
+//      For now, tell the machine where to find the page table -- or,
+//	if there is a TLB holding some other address space's entries,
+//	empty it, so the entries are reloaded from this address space's
+//	page table as they miss.
 //----------------------------------------------------------------------
 
 void AddrSpace::RestoreState()
 {
-    kernel->machine->pageTable = pageTable;
-    kernel->machine->pageTableSize = numPages;
+    if (kernel->machine->tlb != NULL) {
+	if (kernel->cpu->tlbOwner != this) {
+	    kernel->machine->FlushTLB();
+	    kernel->cpu->tlbOwner = this;
+	}
+    } else {
+	kernel->machine->pageTable = pageTable;
+	kernel->machine->pageTableSize = numPages;
+    }
+    kernel->machine->InvalidateTranslations();
+    kernel->machine->profile = profile;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::HandleTLBMiss
+// 	Called on a PageFaultException when the machine has a TLB: load
+//	the page table entry for the faulting address into the TLB, so
+//	the instruction can be restarted.  Whatever entry is replaced
+//	has its use and dirty bits merged back into the page table.
+//
+//	Returns FALSE if the address has no valid translation, in which
+//	case this is a real page fault.
+//
+//	"vaddr" -- the virtual address that missed
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::HandleTLBMiss(unsigned int vaddr)
+{
+    unsigned int vpn = vaddr / PageSize;
+    TranslationEntry evicted;
+
+    ASSERT(kernel->cpu->tlbOwner == this);
+    kernel->stats->numTLBMisses++;
+    if (vpn >= numPages || !pageTable[vpn].valid)
+	return FALSE;
+
+    kernel->machine->RefillTLB(&pageTable[vpn], &evicted);
+    kernel->stats->numTLBRefills++;
+    if (evicted.valid)
+	MergeTLBEntry(&evicted);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::MergeTLBEntry
+// 	Fold the use and dirty bits the hardware set in a TLB entry 
+//	back into the page table entry it was loaded from.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::MergeTLBEntry(TranslationEntry *entry)
+{
+    TranslationEntry *pte = &pageTable[entry->virtualPage];
+
+    ASSERT(entry->virtualPage >= 0 && entry->virtualPage < (int) numPages);
+    pte->use = pte->use || entry->use;
+    pte->dirty = pte->dirty || entry->dirty;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::ChargeFrames
+// 	Called by the frame allocator when this address space gains
+//	or loses physical frames, to keep count of how many it holds
+//	and the most it ever held.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::ChargeFrames(int delta)
+{
+    numFrames += delta;
+    ASSERT(numFrames >= 0);
+    if (numFrames > maxFrames)
+	maxFrames = numFrames;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::SyncTLB
+// 	Merge the use and dirty bits each CPU's TLB has collected back 
+//	into the page table of the address space that owns its entries,
+//	and clear them in the TLB, so that the page replacement policy 
+//	sees every reference made since it last looked.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::SyncTLB()
+{
+    for (int c = 0; c < kernel->numCpus; c++) {
+	Machine *machine = kernel->cpus[c]->machine;
+	AddrSpace *owner = kernel->cpus[c]->tlbOwner;
+
+	if (machine->tlb == NULL || owner == NULL)
+	    continue;
+	for (int i = 0; i < machine->tlbSize; i++) {
+	    if (machine->tlb[i].valid) {
+		owner->MergeTLBEntry(&machine->tlb[i]);
+		machine->tlb[i].use = FALSE;
+		machine->tlb[i].dirty = FALSE;
+	    }
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::PageIn
+// 	Called on a PageFaultException for a page that isn't valid yet.
+//	Pages are filled in lazily: the first time a page is touched it
+//	is read in from the executable (parts outside every segment are
+//	zero filled), or from swap if it was evicted dirty.  Load has
+//	already reserved a frame for it, unless we are demand paging,
+//	in which case the core map finds one.
+//
+//	Returns FALSE if the address isn't in the address space at all.
+//
+//	"vaddr" -- the virtual address that faulted
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::PageIn(unsigned int vaddr)
+{
+    CoreMap *coreMap = kernel->coreMap;
+    unsigned int vpn = vaddr / PageSize;
+    TranslationEntry *pte;
+
+    if (vpn >= numPages)
+	return FALSE;
+
+    pte = &pageTable[vpn];
+    if (coreMap != NULL)
+	coreMap->Acquire();
+    if (!pte->valid) {
+	kernel->stats->numPageFaults++;
+	numFaults++;
+	if (IsShared(vpn)) {		// just map the shared copy
+	    pte->physicalPage = SharedFrame(vpn, TRUE);
+	} else {
+	    if (pte->physicalPage == -1)
+		pte->physicalPage = NewFrame(vpn);
+	    DEBUG(dbgAddr, "Paging in page " << vpn << " to frame "
+				<< pte->physicalPage);
+	    FillPage(vpn, pte->physicalPage);
+	}
+	pte->use = TRUE;
+	pte->dirty = FALSE;
+	pte->valid = TRUE;
+    }
+    if (coreMap != NULL)
+	coreMap->Release();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::NewFrame
+// 	Find a frame of our own to hold page "vpn": from the core map if
+//	we are demand paging, otherwise a free one if there are any.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::NewFrame(int vpn)
+{
+    int frame;
+
+    if (kernel->coreMap != NULL)
+	return kernel->coreMap->Allocate(this, vpn, &pageTable[vpn]);
+
+    frame = kernel->frameAllocator->Allocate(this);
+    if (frame == -1) {
+	kernel->interrupt->setStatus(SystemMode);
+	ExceptionHandler(MemoryLimitException);
+	kernel->interrupt->setStatus(UserMode);
+    }
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::FillPage
+// 	Fill physical frame "frame" with the contents of virtual page
+//	"vpn": from swap if it has been saved there, otherwise from the
+//	executable, zero filling whatever no segment covers.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::FillPage(int vpn, int frame)
+{
+    char *page = &kernel->machine->mainMemory[frame * PageSize];
+
+    if (swapSlot != NULL && swapSlot[vpn] != -1) {
+	kernel->coreMap->ReadSwap(swapSlot[vpn], frame);
+	return;
+    }
+    bzero(page, PageSize);
+    LoadSegment(&noffH.code, vpn, page);
+    LoadSegment(&noffH.initData, vpn, page);
+#ifdef RDATA
+    LoadSegment(&noffH.readonlyData, vpn, page);
+#endif
+    kernel->machine->InvalidateDecoded(frame * PageSize, PageSize);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::PageOut
+// 	The core map has taken the frame holding page "vpn" away from
+//	us.  Invalidate the page, and if it was changed since it was
+//	last read in, save it to swap so PageIn can get it back.
+//
+//	Writing to swap may block, and by the time it returns this
+//	address space may have been deleted, so nothing can touch it
+//	after that.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::PageOut(int vpn)
+{
+    Machine *machine = kernel->machine;
+    TranslationEntry *pte = &pageTable[vpn];
+    int frame = pte->physicalPage;
+
+    ASSERT(pte->valid);
+    DropTLBEntry(vpn);
+    pte->valid = FALSE;
+    pte->physicalPage = -1;
+    machine->InvalidateTranslations();
+
+    if (pte->dirty) {			// the copy we had is out of date
+	pte->dirty = FALSE;
+	if (swapSlot[vpn] == -1)
+	    swapSlot[vpn] = kernel->coreMap->AllocateSwap();
+	kernel->coreMap->WriteSwap(swapSlot[vpn], frame);
+    }
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CopyOnWrite
+// 	Called on a ReadOnlyException.  If the page is one Fork left
+//	shared with another address space, copy it into a frame of our
+//	own and make it writable, so the write can be restarted.  If
+//	the other spaces have since let go of the frame, we can just
+//	take it over.
+//
+//	Returns FALSE if the page really is read-only.
+//
+//	"vaddr" -- the virtual address written to
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::CopyOnWrite(unsigned int vaddr)
+{
+    CoreMap *coreMap = kernel->coreMap;
+    char *memory = kernel->machine->mainMemory;
+    unsigned int vpn = vaddr / PageSize;
+    TranslationEntry *pte;
+    int frame;
+
+    if (vpn >= numPages || IsShared(vpn) || !pageTable[vpn].readOnly)
+	return FALSE;
+
+    pte = &pageTable[vpn];
+    if (coreMap != NULL)
+	coreMap->Acquire();
+    ASSERT(pte->valid);
+    frame = pte->physicalPage;
+    if (kernel->frameAllocator->RefCount(frame) > 1) {
+	int copy = NewFrame(vpn);	// may have to wait for swap
+
+	DEBUG(dbgAddr, "Copying page " << vpn << " from frame " << frame
+			<< " to frame " << copy);
+	bcopy(&memory[frame * PageSize], &memory[copy * PageSize], PageSize);
+	kernel->machine->InvalidateDecoded(copy * PageSize, PageSize);
+	kernel->stats->numPagesCopied++;
+	pte->physicalPage = copy;
+	if (coreMap != NULL)
+	    coreMap->Free(frame);
+	else
+	    kernel->frameAllocator->Free(frame);
+    } else if (coreMap != NULL) {	// nobody else is using it now
+	coreMap->Adopt(frame, this, vpn, pte);
+    } else {
+	kernel->frameAllocator->Reassign(frame, this);
+    }
+    pte->readOnly = FALSE;
+    DropTLBEntry(vpn);
+    kernel->machine->InvalidateTranslations();
+    if (coreMap != NULL)
+	coreMap->Release();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::UserPage
+// 	Return where virtual page "vpn" is in main memory, for the kernel
+//	to read or (if "writing") write it directly.  The page is filled
+//	in if it isn't there, or copied if it is still shared since a
+//	Fork, just as if user code had touched it, and its use and dirty
+//	bits are set.
+//
+//	Returns NULL if there is no such page, or it is read-only.
+//
+//	The page can be taken away again as soon as the kernel lets
+//	another thread run, so the caller must be done with it first.
+//----------------------------------------------------------------------
+
+char *
+AddrSpace::UserPage(unsigned int vpn, bool writing)
+{
+    TranslationEntry *pte;
+
+    if (vpn >= numPages)
+	return NULL;
+    pte = &pageTable[vpn];
+    for (;;) {				// paging may let others run, and
+	if (!pte->valid) {		// they may take the page back
+	    PageIn(vpn * PageSize);
+	} else if (writing && pte->readOnly) {
+	    if (!CopyOnWrite(vpn * PageSize))
+		return NULL;
+	} else {
+	    break;
+	}
+    }
+    pte->use = TRUE;
+    if (writing)
+	pte->dirty = TRUE;
+    return &kernel->machine->mainMemory[pte->physicalPage * PageSize];
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CopyIn
+// 	Copy "size" bytes from virtual address "vaddr" into "buffer",
+//	one page at a time.
+//
+//	Returns FALSE if part of the range isn't in the address space.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::CopyIn(unsigned int vaddr, char *buffer, int size)
+{
+    while (size > 0) {
+	int offset = vaddr % PageSize;
+	int count = min(size, PageSize - offset);
+	char *page = UserPage(vaddr / PageSize, FALSE);
+
+	if (page == NULL)
+	    return FALSE;
+	bcopy(&page[offset], buffer, count);
+	vaddr += count;
+	buffer += count;
+	size -= count;
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CopyOut
+// 	Copy "size" bytes from "buffer" to virtual address "vaddr", one
+//	page at a time.
+//
+//	Returns FALSE if part of the range isn't in the address space,
+//	or is read-only; what comes before it has been copied.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::CopyOut(unsigned int vaddr, char *buffer, int size)
+{
+    while (size > 0) {
+	int offset = vaddr % PageSize;
+	int count = min(size, PageSize - offset);
+	char *page = UserPage(vaddr / PageSize, TRUE);
+
+	if (page == NULL)
+	    return FALSE;
+	bcopy(buffer, &page[offset], count);
+	kernel->machine->InvalidateDecoded(page - kernel->machine->mainMemory
+						+ offset, count);
+	vaddr += count;
+	buffer += count;
+	size -= count;
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CanCopyOut
+// 	Check that all of the "size" bytes at virtual address "vaddr"
+//	can be written, before taking data from somewhere it can't be
+//	put back.  The pages are made ready for CopyOut as a side effect.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::CanCopyOut(unsigned int vaddr, int size)
+{
+    if (size <= 0)
+	return TRUE;
+    for (unsigned int vpn = vaddr / PageSize;
+			vpn <= (vaddr + size - 1) / PageSize; vpn++)
+	if (UserPage(vpn, TRUE) == NULL)
+	    return FALSE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CopyInString
+// 	Copy the null-terminated string at virtual address "vaddr" into
+//	"buffer", which holds "size" bytes, a page at a time.
+//
+//	Returns the length of the string, or -1 if it runs off the end
+//	of the address space or doesn't fit.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::CopyInString(unsigned int vaddr, char *buffer, int size)
+{
+    int length = 0;
+
+    while (length < size) {
+	int offset = vaddr % PageSize;
+	int count = min(size - length, PageSize - offset);
+	char *page = UserPage(vaddr / PageSize, FALSE);
+	char *end;
+
+	if (page == NULL)
+	    return -1;
+	end = (char *) memchr(&page[offset], '\0', count);
+	if (end != NULL) {
+	    count = end - &page[offset];
+	    bcopy(&page[offset], &buffer[length], count + 1);
+	    return length + count;
+	}
+	bcopy(&page[offset], &buffer[length], count);
+	vaddr += count;
+	length += count;
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::DropTLBEntry
+// 	The translation for page "vpn" (or for every page, if "vpn" is
+//	-1) is about to change; if the TLB of any CPU has a copy of it,
+//	merge its use and dirty bits back into the page table and throw
+//	it away.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::DropTLBEntry(int vpn)
+{
+    for (int c = 0; c < kernel->numCpus; c++) {
+	Machine *machine = kernel->cpus[c]->machine;
+
+	if (machine->tlb == NULL || kernel->cpus[c]->tlbOwner != this)
+	    continue;
+	for (int i = 0; i < machine->tlbSize; i++) {
+	    if (machine->tlb[i].valid 
+			&& (vpn == -1 || machine->tlb[i].virtualPage == vpn)) {
+		MergeTLBEntry(&machine->tlb[i]);
+		machine->tlb[i].valid = FALSE;
+	    }
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::LoadSegment
+// 	Copy whatever part of "segment" falls inside virtual page "vpn"
+//	from the executable into "page".
+//----------------------------------------------------------------------
+
+void
+AddrSpace::LoadSegment(Segment *segment, int vpn, char *page)
+{
+    int start = vpn * PageSize;
+    int end = start + PageSize;
+
+    if (segment->size <= 0)
+	return;
+    if (segment->virtualAddr > start)
+	start = segment->virtualAddr;
+    if (segment->virtualAddr + segment->size < end)
+	end = segment->virtualAddr + segment->size;
+    if (start < end) {
+	executable->ReadAt(&page[start - vpn * PageSize], end - start,
+		segment->inFileAddr + (start - segment->virtualAddr));
+    }
 }
 
 //----------------------------------------------------------------------
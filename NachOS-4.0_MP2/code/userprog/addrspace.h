@@ -15,12 +15,18 @@
 
 #include "copyright.h"
 #include "filesys.h"
+#include "noff.h"
+
+class SharedText;
+class Profile;
 
 #define UserStackSize		1024 	// increase this as necessary!
 
 class AddrSpace {
   public:
     AddrSpace();			// Create an address space.
+    AddrSpace(AddrSpace *parent);	// Create a copy-on-write copy of
+					// "parent", for Fork
     ~AddrSpace();			// De-allocate an address space
 
     bool Load(char *fileName);		// Load a program into addr space from
@@ -39,6 +45,44 @@ class AddrSpace {
     // is 0 for Read, 1 for Write.
     ExceptionType Translate(unsigned int vaddr, unsigned int *paddr, int mode);
 
+    bool HandleTLBMiss(unsigned int vaddr);
+					// Load the translation for vaddr
+					// into the TLB; FALSE if there is
+					// no valid one
+
+    bool PageIn(unsigned int vaddr);	// Fill in the page holding vaddr
+					// on its first touch (or after it
+					// was evicted); FALSE if there is
+					// no such page
+    void PageOut(int vpn);		// Give up the frame holding "vpn",
+					// saving it to swap if need be
+    bool CopyOnWrite(unsigned int vaddr);
+					// Give this space its own copy of
+					// a page shared since a Fork; FALSE
+					// if the page is really read-only
+
+    // Copy between the kernel and this address space's memory, a page
+    // at a time, filling in pages as need be.  Each returns FALSE (or
+    // -1) if the user buffer isn't all there, or can't be written.
+    bool CopyIn(unsigned int vaddr, char *buffer, int size);
+					// Copy "size" bytes in from "vaddr"
+    bool CopyOut(unsigned int vaddr, char *buffer, int size);
+					// Copy "size" bytes out to "vaddr"
+    bool CanCopyOut(unsigned int vaddr, int size);
+					// Could "size" bytes be copied out
+					// to "vaddr"?
+    int CopyInString(unsigned int vaddr, char *buffer, int size);
+					// Copy in a null-terminated string
+					// of less than "size" bytes, and
+					// return its length
+
+    void ChargeFrames(int delta);	// Account for frames gained or lost
+    int FramesInUse() { return numFrames; }
+    int MaxFramesInUse() { return maxFrames; }
+
+    static void SyncTLB();		// Merge the use and dirty bits the
+					// TLBs have collected into the page
+					// tables they came from
     
   private:
     TranslationEntry *pageTable;	// Assume linear page table translation
@@ -46,8 +90,48 @@ class AddrSpace {
     unsigned int numPages;		// Number of pages in the virtual 
 					// address space
 
+    // Pages are read in from the executable as they are touched, and
+    // when demand paging, written to swap when evicted.
+    char *fileName;			// the program's name, and
+    OpenFile *executable;		// the program
+    NoffHeader noffH;			// where its segments are in the file
+    int *swapSlot;			// swap slot holding each page, or -1
+
+    SharedText *text;			// code pages shared with other
+					// spaces running the same program
+
+    int numFrames;			// physical frames held now
+    int maxFrames;			// the most ever held at once
+    int numFaults;			// pages filled in on first touch,
+					// or brought back from swap
+    double loadTime;			// host seconds spent in Load
+    int startTick;			// when the program started running
+    Profile *profile;			// watches the program run; NULL
+					// unless profiling (see -prof)
+
     void InitRegisters();		// Initialize user-level CPU registers,
 					// before jumping to user code
+
+    void MergeTLBEntry(TranslationEntry *entry);
+					// Copy the use and dirty bits from
+					// a TLB entry into the page table
+    void DropTLBEntry(int vpn);		// Remove any TLB copy of "vpn"'s
+					// translation, which is changing
+					// (-1 for every page)
+
+    void AttachText(char *fileName);	// Share code pages with other
+    void DetachText();			// copies of the program
+    bool IsShared(int vpn);		// Is "vpn" a shared code page?
+    int SharedFrame(int vpn, bool fill);// Frame holding shared page "vpn"
+    int NewFrame(int vpn);		// Find a private frame for "vpn"
+    char *UserPage(unsigned int vpn, bool writing);
+					// Where page "vpn" is in memory,
+					// faulting it in if need be
+    void FillPage(int vpn, int frame);	// Read in the contents of "vpn"
+
+    void LoadSegment(Segment *segment, int vpn, char *page);
+					// Read the part of "segment" that
+					// falls in page "vpn"
 };
 
 #endif // ADDRSPACE_H
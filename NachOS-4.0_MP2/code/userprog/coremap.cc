@@ -0,0 +1,582 @@
+// coremap.cc
+//	Routines to allocate physical frames, and for demand paging, to
+//	keep track of what they hold, choose frames to reclaim, and
+//	move pages to and from the swap area on the simulated disk.
+//
+//	When there is no file system on the disk (FILESYS_STUB), the
+//	whole disk is used as swap space, one page per sector.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "main.h"
+#include "coremap.h"
+#include "addrspace.h"
+#include "synch.h"
+#include "synchdisk.h"
+
+//----------------------------------------------------------------------
+// FrameAllocator::FrameAllocator
+// 	Initialize the frame allocator, with every frame free.
+//
+//	"numFrames" -- the number of physical frames to hand out
+//----------------------------------------------------------------------
+
+FrameAllocator::FrameAllocator(int numFrames)
+{
+    this->numFrames = numFrames;
+    numWords = divRoundUp(numFrames, BitsInWord);
+    freeMap = new unsigned int[numWords];
+    for (int i = 0; i < numWords; i++)
+	freeMap[i] = 0;
+    for (int i = 0; i < numFrames; i++)	// bits past the end stay clear
+	freeMap[i / BitsInWord] |= 1U << (i % BitsInWord);
+    firstWord = 0;
+    numFree = numFrames;
+    owner = new AddrSpace *[numFrames];
+    refCount = new int[numFrames];
+    for (int i = 0; i < numFrames; i++) {
+	owner[i] = NULL;
+	refCount[i] = 0;
+    }
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::~FrameAllocator
+// 	De-allocate the frame allocator.
+//----------------------------------------------------------------------
+
+FrameAllocator::~FrameAllocator()
+{
+    delete [] freeMap;
+    delete [] owner;
+    delete [] refCount;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::Take
+// 	Mark a free frame as used by "space" (NULL for the kernel),
+//	and charge it to the space and to the system-wide totals.
+//----------------------------------------------------------------------
+
+void
+FrameAllocator::Take(int frame, AddrSpace *space)
+{
+    Statistics *stats = kernel->stats;
+
+    ASSERT(IsFree(frame));
+    freeMap[frame / BitsInWord] &= ~(1U << (frame % BitsInWord));
+    numFree--;
+    owner[frame] = space;
+    refCount[frame] = 1;
+    if (space != NULL)
+	space->ChargeFrames(1);
+    stats->numFramesInUse++;
+    if (stats->numFramesInUse > stats->maxFramesInUse)
+	stats->maxFramesInUse = stats->numFramesInUse;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::Allocate
+// 	Take the lowest numbered free frame for "space".  Words with no
+//	free frames are skipped whole, and words below "firstWord" are
+//	known to be full and are not looked at at all.
+//
+//	Returns the frame number, or -1 if every frame is in use.
+//----------------------------------------------------------------------
+
+int
+FrameAllocator::Allocate(AddrSpace *space)
+{
+    for (int w = firstWord; w < numWords; w++) {
+	if (freeMap[w] != 0) {
+	    int frame = w * BitsInWord + ffs((int) freeMap[w]) - 1;
+
+	    firstWord = w;
+	    Take(frame, space);
+	    return frame;
+	}
+    }
+    firstWord = numWords;
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::AllocateRun
+// 	Take the lowest run of "count" adjacent free frames for "space".
+//	Full words, and used frames up to the next free one in a word,
+//	are stepped over in one go.
+//
+//	Returns the first frame of the run, or -1 if there is no free
+//	run that long.
+//----------------------------------------------------------------------
+
+int
+FrameAllocator::AllocateRun(AddrSpace *space, int count)
+{
+    int run = 0;			// free frames just before "frame"
+    int frame = firstWord * BitsInWord;
+
+    ASSERT(count > 0);
+    if (count > numFree)
+	return -1;
+    while (frame < numFrames && run < count) {
+	int bit = frame % BitsInWord;
+	unsigned int word = freeMap[frame / BitsInWord] >> bit;
+
+	if (bit == 0 && word == ~0U) {	// a whole word free
+	    run += BitsInWord;
+	    frame += BitsInWord;
+	} else if (word == 0) {		// nothing free in the rest of it
+	    run = 0;
+	    frame += BitsInWord - bit;
+	} else if (word & 1) {
+	    run++;
+	    frame++;
+	} else {			// skip to the next free frame
+	    run = 0;
+	    frame += ffs((int) word) - 1;
+	}
+    }
+    if (run < count)
+	return -1;
+
+    frame -= run;
+    for (int i = 0; i < count; i++)
+	Take(frame + i, space);
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::Free
+// 	One of the users of a frame is done with it.  When the last one
+//	is, return the frame to the free pool, uncharging whoever had it.
+//----------------------------------------------------------------------
+
+void
+FrameAllocator::Free(int frame)
+{
+    int w = frame / BitsInWord;
+
+    ASSERT(frame >= 0 && frame < numFrames && !IsFree(frame));
+    if (--refCount[frame] > 0)
+	return;
+    if (owner[frame] != NULL)
+	owner[frame]->ChargeFrames(-1);
+    owner[frame] = NULL;
+    freeMap[w] |= 1U << (frame % BitsInWord);
+    numFree++;
+    if (w < firstWord)
+	firstWord = w;
+    kernel->stats->numFramesInUse--;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::Reassign
+// 	Hand a frame that is in use over to "space", moving the charge
+//	for it from its old owner.  Used when a page is evicted to make
+//	room for another.
+//----------------------------------------------------------------------
+
+void
+FrameAllocator::Reassign(int frame, AddrSpace *space)
+{
+    ASSERT(frame >= 0 && frame < numFrames && !IsFree(frame));
+    if (owner[frame] != NULL)
+	owner[frame]->ChargeFrames(-1);
+    owner[frame] = space;
+    if (space != NULL)
+	space->ChargeFrames(1);
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::Share
+// 	Another address space is mapping a frame in use.  The frame now
+//	belongs to all of them, so it is no longer charged to anyone.
+//----------------------------------------------------------------------
+
+void
+FrameAllocator::Share(int frame)
+{
+    ASSERT(frame >= 0 && frame < numFrames && !IsFree(frame));
+    if (owner[frame] != NULL)
+	owner[frame]->ChargeFrames(-1);
+    owner[frame] = NULL;
+    refCount[frame]++;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::SelfTest
+// 	Check single frame and run allocation on a small allocator whose
+//	size isn't a multiple of the word size.  The system-wide frame
+//	counts are put back afterwards.
+//----------------------------------------------------------------------
+
+void
+FrameAllocator::SelfTest()
+{
+    Statistics *stats = kernel->stats;
+    int inUse = stats->numFramesInUse;
+    int maxInUse = stats->maxFramesInUse;
+    FrameAllocator *frames = new FrameAllocator(2 * BitsInWord + 5);
+    int n = frames->numFrames;
+
+    for (int i = 0; i < n; i++)		// lowest first
+	ASSERT(frames->Allocate(NULL) == i);
+    ASSERT(frames->Allocate(NULL) == -1 && frames->NumFree() == 0);
+
+    frames->Free(3);			// holes at 3, 40..42 and the last 5
+    for (int i = 40; i < 43; i++)
+	frames->Free(i);
+    for (int i = n - 5; i < n; i++)
+	frames->Free(i);
+    ASSERT(frames->AllocateRun(NULL, 6) == -1);
+    ASSERT(frames->AllocateRun(NULL, 2) == 40);
+    ASSERT(frames->Allocate(NULL) == 3);
+    ASSERT(frames->AllocateRun(NULL, 5) == n - 5);
+    ASSERT(frames->Allocate(NULL) == 42);
+    ASSERT(frames->NumFree() == 0);
+
+    for (int i = 0; i < n; i++)		// a run across word boundaries
+	frames->Free(i);
+    ASSERT(frames->AllocateRun(NULL, 1) == 0);
+    ASSERT(frames->AllocateRun(NULL, BitsInWord + 3) == 1);
+    ASSERT(frames->Allocate(NULL) == BitsInWord + 4);
+    ASSERT(frames->AllocateRun(NULL, n) == -1);
+
+    frames->Share(0);			// shared frames outlive a Free
+    ASSERT(frames->RefCount(0) == 2);
+    frames->Free(0);
+    ASSERT(frames->RefCount(0) == 1 && frames->Allocate(NULL) != 0);
+    frames->Free(0);
+    ASSERT(frames->Allocate(NULL) == 0);
+    delete frames;
+
+    stats->numFramesInUse = inUse;
+    stats->maxFramesInUse = maxInUse;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::CoreMap
+// 	Initialize the core map: every frame is free, and so is the
+//	swap area.
+//
+//	"policy" -- how to pick the page to evict when memory is full
+//----------------------------------------------------------------------
+
+CoreMap::CoreMap(ReplacementPolicy policy)
+{
+    this->policy = policy;
+    frames = new FrameInfo[NumPhysPages];
+    for (int i = 0; i < NumPhysPages; i++) {
+	frames[i].owner = NULL;
+	frames[i].virtualPage = -1;
+	frames[i].entry = NULL;
+    }
+    lock = new Lock("core map");
+    nextStamp = 0;
+    hand = 0;
+
+    ASSERT(PageSize == SectorSize);	// swap slots are disk sectors
+#ifdef FILESYS_STUB
+    numSwapPages = NumSectors;
+#else
+    numSwapPages = 0;			// the file system owns the disk
+#endif
+    swapMap = new Bitmap(numSwapPages > 0 ? numSwapPages : 1);
+}
+
+//----------------------------------------------------------------------
+// CoreMap::~CoreMap
+// 	De-allocate the core map.
+//----------------------------------------------------------------------
+
+CoreMap::~CoreMap()
+{
+    delete [] frames;
+    delete lock;
+    delete swapMap;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::Acquire, CoreMap::Release
+// 	Hold the core map while faulting a page in, so that only one
+//	thread at a time is evicting pages or waiting on swap I/O.
+//----------------------------------------------------------------------
+
+void
+CoreMap::Acquire()
+{
+    lock->Acquire();
+}
+
+void
+CoreMap::Release()
+{
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// CoreMap::Allocate
+// 	Find a frame to hold virtual page "vpn" of "space".  If there
+//	are no free frames, reclaim one according to the replacement
+//	policy; its owner writes the page out to swap if need be,
+//	which may block.
+//
+//	Must be called with the core map lock held.  The caller fills
+//	in the frame and then marks "entry" valid.
+//----------------------------------------------------------------------
+
+int
+CoreMap::Allocate(AddrSpace *space, int vpn, TranslationEntry *entry)
+{
+    int frame = kernel->frameAllocator->Allocate(space);
+
+    ASSERT(lock->IsHeldByCurrentThread());
+    if (frame == -1) {
+	AddrSpace *owner;
+	int victim;
+
+	frame = PickVictim();
+	owner = frames[frame].owner;
+	victim = frames[frame].virtualPage;
+	DEBUG(dbgAddr, "Evicting page " << victim << " from frame " << frame);
+	frames[frame].owner = NULL;
+	kernel->frameAllocator->Reassign(frame, space);
+	owner->PageOut(victim);		// after this, "owner" may be gone
+    }
+
+    frames[frame].owner = space;
+    frames[frame].virtualPage = vpn;
+    frames[frame].entry = entry;
+    frames[frame].loadStamp = nextStamp++;
+    frames[frame].age = 1U << 31;	// as if just referenced
+    frames[frame].lastUse = kernel->stats->totalTicks;
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::Free
+// 	Note that the owner of "frame" no longer needs it, and return
+//	it to the pool of free frames.
+//----------------------------------------------------------------------
+
+void
+CoreMap::Free(int frame)
+{
+    ASSERT(frame >= 0 && frame < NumPhysPages);
+    frames[frame].owner = NULL;
+    frames[frame].entry = NULL;
+    kernel->frameAllocator->Free(frame);
+}
+
+//----------------------------------------------------------------------
+// CoreMap::Share
+// 	A frame is about to be mapped by more than one address space.
+//	Take it out of the pages that can be reclaimed: its page table
+//	entries would all have to be invalidated together.
+//----------------------------------------------------------------------
+
+void
+CoreMap::Share(int frame)
+{
+    ASSERT(lock->IsHeldByCurrentThread());
+    frames[frame].owner = NULL;
+    frames[frame].entry = NULL;
+    kernel->frameAllocator->Share(frame);
+}
+
+//----------------------------------------------------------------------
+// CoreMap::Adopt
+// 	A shared frame is down to its last user, page "vpn" of "space".
+//	Give it to that space, so it can be reclaimed like any other.
+//----------------------------------------------------------------------
+
+void
+CoreMap::Adopt(int frame, AddrSpace *space, int vpn, TranslationEntry *entry)
+{
+    ASSERT(lock->IsHeldByCurrentThread());
+    ASSERT(kernel->frameAllocator->RefCount(frame) == 1);
+    kernel->frameAllocator->Reassign(frame, space);
+    frames[frame].owner = space;
+    frames[frame].virtualPage = vpn;
+    frames[frame].entry = entry;
+    frames[frame].loadStamp = nextStamp++;
+    frames[frame].age = 1U << 31;
+    frames[frame].lastUse = kernel->stats->totalTicks;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::SampleUseBits
+// 	Record which pages were referenced since the last sample, and
+//	clear their use bits so the next sample sees fresh references.
+//	Any use bits still sitting in the TLB are merged in first.
+//----------------------------------------------------------------------
+
+void
+CoreMap::SampleUseBits()
+{
+    int now = kernel->stats->totalTicks;
+
+    AddrSpace::SyncTLB();
+    for (int i = 0; i < NumPhysPages; i++) {
+	if (frames[i].owner == NULL)
+	    continue;
+	frames[i].age >>= 1;
+	if (frames[i].entry->use) {
+	    frames[i].age |= 1U << 31;
+	    frames[i].lastUse = now;
+	    frames[i].entry->use = FALSE;
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// CoreMap::PickVictim
+// 	Choose an occupied frame to reclaim.  Only called when there are
+//	no free frames.
+//----------------------------------------------------------------------
+
+int
+CoreMap::PickVictim()
+{
+    int victim = -1;
+    int now = kernel->stats->totalTicks;
+
+    switch (policy) {
+      case ReplaceFIFO:
+	for (int i = 0; i < NumPhysPages; i++) {
+	    if (frames[i].owner != NULL && (victim == -1 ||
+		    frames[i].loadStamp < frames[victim].loadStamp))
+		victim = i;
+	}
+	break;
+
+      case ReplaceClock:		// give each used page a second chance
+	AddrSpace::SyncTLB();
+	for (int n = 0; n < 2 * NumPhysPages && victim == -1; n++) {
+	    FrameInfo *f = &frames[hand];
+
+	    if (f->owner != NULL) {
+		if (f->entry->use)
+		    f->entry->use = FALSE;
+		else
+		    victim = hand;
+	    }
+	    hand = (hand + 1) % NumPhysPages;
+	}
+	break;
+
+      case ReplaceLRU:			// smallest age is least recently used
+	SampleUseBits();
+	for (int i = 0; i < NumPhysPages; i++) {
+	    if (frames[i].owner != NULL && (victim == -1 ||
+		    frames[i].age < frames[victim].age))
+		victim = i;
+	}
+	break;
+
+      case ReplaceWorkingSet:		// first page out of its working set,
+					// else the one idle the longest
+	SampleUseBits();
+	for (int n = 0; n < NumPhysPages; n++) {
+	    int i = (hand + n) % NumPhysPages;
+
+	    if (frames[i].owner == NULL)
+		continue;
+	    if (now - frames[i].lastUse > WorkingSetWindow) {
+		victim = i;
+		break;
+	    }
+	    if (victim == -1 || frames[i].lastUse < frames[victim].lastUse)
+		victim = i;
+	}
+	hand = (victim + 1) % NumPhysPages;
+	break;
+    }
+    ASSERT(victim != -1);
+    return victim;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::AllocateSwap
+// 	Reserve a page of swap space, returning its slot number.
+//----------------------------------------------------------------------
+
+int
+CoreMap::AllocateSwap()
+{
+    int slot = (numSwapPages > 0) ? swapMap->FindAndSet() : -1;
+
+    if (slot == -1) {
+	cerr << "Out of swap space\n";
+	ASSERTNOTREACHED();
+    }
+    return slot;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::FreeSwap
+// 	Release a page of swap space.
+//----------------------------------------------------------------------
+
+void
+CoreMap::FreeSwap(int slot)
+{
+    ASSERT(swapMap->Test(slot));
+    swapMap->Clear(slot);
+}
+
+//----------------------------------------------------------------------
+// CoreMap::ReadSwap
+// 	Copy the page in swap slot "slot" into physical frame "frame",
+//	waiting for the disk.
+//----------------------------------------------------------------------
+
+void
+CoreMap::ReadSwap(int slot, int frame)
+{
+    Machine *machine = kernel->machine;
+
+    DEBUG(dbgAddr, "Reading swap slot " << slot << " into frame " << frame);
+    kernel->stats->numSwapReads++;
+    kernel->synchDisk->ReadSector(slot, &machine->mainMemory[frame * PageSize]);
+    machine->InvalidateDecoded(frame * PageSize, PageSize);
+}
+
+//----------------------------------------------------------------------
+// CoreMap::WriteSwap
+// 	Copy physical frame "frame" out to swap slot "slot", waiting
+//	for the disk.
+//----------------------------------------------------------------------
+
+void
+CoreMap::WriteSwap(int slot, int frame)
+{
+    DEBUG(dbgAddr, "Writing frame " << frame << " to swap slot " << slot);
+    kernel->stats->numSwapWrites++;
+    kernel->synchDisk->WriteSector(slot,
+			&kernel->machine->mainMemory[frame * PageSize]);
+}
+
+//----------------------------------------------------------------------
+// CoreMap::CopySwap
+// 	Make a copy of the page in swap slot "slot", for a forked
+//	address space, and return the slot holding the copy.
+//----------------------------------------------------------------------
+
+int
+CoreMap::CopySwap(int slot)
+{
+    char buffer[SectorSize];
+    int copy = AllocateSwap();
+
+    DEBUG(dbgAddr, "Copying swap slot " << slot << " to " << copy);
+    kernel->stats->numSwapReads++;
+    kernel->synchDisk->ReadSector(slot, buffer);
+    kernel->stats->numSwapWrites++;
+    kernel->synchDisk->WriteSector(copy, buffer);
+    return copy;
+}
@@ -0,0 +1,142 @@
+// coremap.h
+//	Data structures for managing physical memory.
+//
+//	A FrameAllocator keeps track of which frames are free and which
+//	address space has each of the others.
+//
+//	For demand paging there is also a "core map" recording which
+//	virtual page each physical frame holds, the policy used to pick
+//	a frame to reclaim when memory runs out, and the swap area on
+//	the simulated disk that evicted pages are written to.
+//
+//	All paging is done with the core map's lock held, so only one
+//	thread at a time is choosing victims or moving pages to and
+//	from the disk.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef COREMAP_H
+#define COREMAP_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "translate.h"
+#include "bitmap.h"
+
+class AddrSpace;
+class Lock;
+
+// The free frames are a bitmap packed into words, so a free frame is
+// found a word at a time with ffs() rather than by testing each frame.
+// The allocator also charges each frame to the address space using it.
+//
+// A frame can be mapped by several address spaces at once (after a
+// Fork, until one of them writes to it), so each frame has a count of
+// its users and is only freed when the last of them is done with it.
+// A frame in use by more than one space is charged to none of them.
+
+class FrameAllocator {
+  public:
+    FrameAllocator(int numFrames);	// Initialize, with every frame free
+    ~FrameAllocator();
+
+    int Allocate(AddrSpace *space);	// Take a free frame for "space";
+					// -1 if there are none
+    int AllocateRun(AddrSpace *space, int count);
+					// Take "count" adjacent free frames,
+					// returning the first; -1 if there
+					// is no free run that long
+    void Free(int frame);		// Drop a use of a frame, returning
+					// it to the free pool after the last
+    void Reassign(int frame, AddrSpace *space);
+					// Charge a frame in use to "space"
+    void Share(int frame);		// Add a user of a frame in use
+
+    AddrSpace *Owner(int frame) { return owner[frame]; }
+    int RefCount(int frame) { return refCount[frame]; }
+    int NumFree() { return numFree; }
+
+    void SelfTest();			// Test the allocator
+
+  private:
+    int numFrames;			// frames managed
+    int numWords;			// words in freeMap
+    unsigned int *freeMap;		// bit set if the frame is free
+    int firstWord;			// no free frames in words below this
+    int numFree;			// number of bits set in freeMap
+    AddrSpace **owner;			// the space using each frame
+    int *refCount;			// how many spaces map each frame
+
+    void Take(int frame, AddrSpace *space);
+					// Mark a free frame as used
+    bool IsFree(int frame)
+	{ return (freeMap[frame / BitsInWord] >> (frame % BitsInWord)) & 1; }
+};
+
+// How to choose the frame to reclaim when there are no free ones.
+
+enum ReplacementPolicy {
+    ReplaceFIFO,		// the page that was loaded longest ago
+    ReplaceClock,		// second chance, using the use bits
+    ReplaceLRU,			// LRU approximation, by aging the use bits
+    ReplaceWorkingSet		// a page outside its space's working set
+};
+
+// A page not referenced in this many ticks is outside the working set.
+const int WorkingSetWindow = 20000;
+
+// What the core map knows about one physical frame.
+
+class FrameInfo {
+  public:
+    AddrSpace *owner;		// address space using the frame;
+				// NULL if the frame is free
+    int virtualPage;		// the page of "owner" held in the frame
+    TranslationEntry *entry;	// owner's page table entry for the page
+    unsigned int loadStamp;	// order in which pages were loaded (FIFO)
+    unsigned int age;		// aged use bits, newest in the top bit (LRU)
+    int lastUse;		// last time the page was seen in use
+				// (working set)
+};
+
+class CoreMap {
+  public:
+    CoreMap(ReplacementPolicy policy);	// Initialize an empty core map
+    ~CoreMap();				// De-allocate the core map
+
+    void Acquire();			// Serialize paging activity
+    void Release();
+
+    int Allocate(AddrSpace *space, int vpn, TranslationEntry *entry);
+					// Find a frame for "vpn" of "space",
+					// evicting another page if need be
+    void Free(int frame);		// The frame's owner is done with it
+    void Share(int frame);		// Pin a frame mapped by several spaces
+    void Adopt(int frame, AddrSpace *space, int vpn, TranslationEntry *entry);
+					// Hand a pinned frame back to a
+					// single owner, to be paged again
+
+    int SwapSize() { return numSwapPages; }
+    int AllocateSwap();			// Reserve a page of swap space
+    void FreeSwap(int slot);		// Release a page of swap space
+    void ReadSwap(int slot, int frame);	// Copy a page in from swap
+    void WriteSwap(int slot, int frame);// Copy a page out to swap
+    int CopySwap(int slot);		// Duplicate a page of swap
+
+  private:
+    ReplacementPolicy policy;		// how victims are chosen
+    FrameInfo *frames;			// one entry per physical frame
+    Lock *lock;				// only one pager at a time
+    unsigned int nextStamp;		// loadStamp for the next page in
+    int hand;				// where the clock sweep resumes
+
+    int numSwapPages;			// size of the swap area, in pages
+    Bitmap *swapMap;			// which swap slots are in use
+
+    int PickVictim();			// Choose a frame to reclaim
+    void SampleUseBits();		// Age the use bits (LRU, working set)
+};
+
+#endif // COREMAP_H
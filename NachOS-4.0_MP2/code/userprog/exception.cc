@@ -25,6 +25,11 @@
 #include "main.h"
 #include "syscall.h"
 #include "ksyscall.h"
+
+// The longest string (file name or message) a system call copies in
+// from a user program, counting the null at the end.
+const int MaxStringLength = 256;
+
 //----------------------------------------------------------------------
 // ExceptionHandler
 // 	Entry point into the Nachos kernel.  Called when a user program
@@ -83,8 +88,9 @@ void ExceptionHandler(ExceptionType which)
 			DEBUG(dbgSys, "Message received.\n");
 			val = kernel->machine->ReadRegister(4);
 			{
-				char *msg = &(kernel->machine->mainMemory[val]);
-				cout << msg << endl;
+				char msg[MaxStringLength];
+				if (kernel->currentThread->space->CopyInString(val, msg, MaxStringLength) >= 0)
+					cout << msg << endl;
 			}
 			SysHalt();
 			ASSERTNOTREACHED();
@@ -92,9 +98,12 @@ void ExceptionHandler(ExceptionType which)
 		case SC_Create:
 			val = kernel->machine->ReadRegister(4);
 			{
-				char *filename = &(kernel->machine->mainMemory[val]);
+				char filename[MaxStringLength];
 				// cout << filename << endl;
-				status = SysCreate(filename);
+				if (kernel->currentThread->space->CopyInString(val, filename, MaxStringLength) < 0)
+					status = 0;
+				else
+					status = SysCreate(filename);
 				kernel->machine->WriteRegister(2, (int)status);
 			}
 			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
@@ -106,8 +115,11 @@ void ExceptionHandler(ExceptionType which)
 		case SC_Open:
 			val = kernel->machine->ReadRegister(4);
 			{
-				char *filename = &(kernel->machine->mainMemory[val]);
-				status = SysOpen(filename);
+				char filename[MaxStringLength];
+				if (kernel->currentThread->space->CopyInString(val, filename, MaxStringLength) < 0)
+					status = -1;
+				else
+					status = SysOpen(filename);
 				kernel->machine->WriteRegister(2, (int)status);
 			}
 			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
@@ -119,11 +131,36 @@ void ExceptionHandler(ExceptionType which)
 
 		case SC_Write:
 			val = kernel->machine->ReadRegister(4);
-			{
-				char *filename = &(kernel->machine->mainMemory[val]);
-				status = SysWrite(filename, (int)kernel->machine->ReadRegister(5), (OpenFileId)kernel->machine->ReadRegister(6));
-				kernel->machine->WriteRegister(2, (int)status);
+			numChar = kernel->machine->ReadRegister(5);
+			fileID = kernel->machine->ReadRegister(6);
+			if (numChar < 0) {
+				status = -1;
+			} else {
+				// A page at a time, so however much is asked for,
+				// the kernel buffers no more than that.
+				char buffer[PageSize];
+				int chunk, written;
+
+				status = 0;
+				while (status < numChar) {
+					chunk = min(numChar - status, PageSize);
+					if (!kernel->currentThread->space->CopyIn(val + status, buffer, chunk)) {
+						if (status == 0)
+							status = -1;
+						break;
+					}
+					written = SysWrite(buffer, chunk, (OpenFileId)fileID);
+					if (written <= 0) {
+						if (status == 0)
+							status = written;
+						break;
+					}
+					status += written;
+					if (written < chunk)
+						break;		// short write: no further
+				}
 			}
+			kernel->machine->WriteRegister(2, (int)status);
 			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
 			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
 			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
@@ -133,11 +170,42 @@ void ExceptionHandler(ExceptionType which)
 
 		case SC_Read:
 			val = kernel->machine->ReadRegister(4);
-			{
-				char *filename = &(kernel->machine->mainMemory[val]);
-				status = SysRead(filename, (int)kernel->machine->ReadRegister(5), (OpenFileId)kernel->machine->ReadRegister(6));
-				kernel->machine->WriteRegister(2, (int)status);
+			numChar = kernel->machine->ReadRegister(5);
+			fileID = kernel->machine->ReadRegister(6);
+			if (numChar < 0) {
+				status = -1;
+			} else {
+				// A page at a time, as for SC_Write.  Whatever
+				// is read can't be put back, so make sure it
+				// has somewhere to go first.
+				char buffer[PageSize];
+				int chunk, got;
+
+				status = 0;
+				while (status < numChar) {
+					chunk = min(numChar - status, PageSize);
+					if (!kernel->currentThread->space->CanCopyOut(val + status, chunk)) {
+						if (status == 0)
+							status = -1;
+						break;
+					}
+					got = SysRead(buffer, chunk, (OpenFileId)fileID);
+					if (got <= 0) {
+						if (status == 0)
+							status = got;
+						break;
+					}
+					if (!kernel->currentThread->space->CopyOut(val + status, buffer, got)) {
+						if (status == 0)
+							status = -1;
+						break;
+					}
+					status += got;
+					if (got < chunk)
+						break;		// short read: no more for now
+				}
 			}
+			kernel->machine->WriteRegister(2, (int)status);
 			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
 			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
 			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
@@ -181,10 +249,57 @@ void ExceptionHandler(ExceptionType which)
 			return;
 			ASSERTNOTREACHED();
 			break;
+		case SC_Exec:
+			val = kernel->machine->ReadRegister(4);
+			{
+				char filename[MaxStringLength];
+				if (kernel->currentThread->space->CopyInString(val, filename, MaxStringLength) < 0)
+					status = -1;
+				else
+					status = SysExec(filename);
+				kernel->machine->WriteRegister(2, (int)status);
+			}
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_Fork:
+			DEBUG(dbgSys, "Fork\n");
+			// The copy starts out with our registers, so move
+			// past the syscall first.
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			status = SysFork();
+			kernel->machine->WriteRegister(2, (int)status);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_Sleep:
+			DEBUG(dbgSys, "Sleep " << kernel->machine->ReadRegister(4) << "\n");
+			SysSleep((int)kernel->machine->ReadRegister(4));
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_Join:
+			status = SysJoin((SpaceId)kernel->machine->ReadRegister(4));
+			kernel->machine->WriteRegister(2, (int)status);
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
 		case SC_Exit:
 			DEBUG(dbgAddr, "Program exit\n");
 			val = kernel->machine->ReadRegister(4);
 			cout << "return value:" << val << endl;
+			SysExit(val);
 			kernel->currentThread->Finish();
 			break;
 		default:
@@ -192,6 +307,28 @@ void ExceptionHandler(ExceptionType which)
 			break;
 		}
 		break;
+	case PageFaultException:
+		// With a TLB, most of these are just TLB misses; reload
+		// the entry and let the instruction run again.
+		if (kernel->machine->tlb != NULL && kernel->currentThread->space->
+			HandleTLBMiss(kernel->machine->ReadRegister(BadVAddrReg))) {
+			return;
+		}
+		// The rest are pages not filled in yet, or paged out.
+		if (kernel->currentThread->space->
+			PageIn(kernel->machine->ReadRegister(BadVAddrReg))) {
+			return;
+		}
+		cerr << "Unexpected user mode exception " << (int)which << "\n";
+		break;
+	case ReadOnlyException:
+		// Writes to pages shared since a Fork get a private copy.
+		if (kernel->currentThread->space->
+			CopyOnWrite(kernel->machine->ReadRegister(BadVAddrReg))) {
+			return;
+		}
+		cerr << "Unexpected user mode exception " << (int)which << "\n";
+		break;
 	default:
 		cerr << "Unexpected user mode exception " << (int)which << "\n";
 		break;
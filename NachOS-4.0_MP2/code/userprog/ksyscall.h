@@ -59,6 +59,34 @@ int SysClose(OpenFileId id)
 {
 	return kernel->fileSystem->CloseFile(id);
 }
+
+SpaceId SysExec(char *name)
+{
+	char *copy = new char[strlen(name) + 1];	// becomes the thread's name
+
+	strcpy(copy, name);
+	return kernel->Exec(copy, kernel->currentThread->priority);
+}
+
+SpaceId SysFork()
+{
+	return kernel->Fork();
+}
+
+int SysJoin(SpaceId id)
+{
+	return kernel->Join(id);
+}
+
+void SysExit(int status)
+{
+	kernel->ProgramExit(status);
+}
+
+void SysSleep(int ticks)
+{
+	kernel->alarm->WaitUntil(ticks);
+}
 //When you finish the function "OpenAFile", you can remove the comment below.
 /*
 OpenFileId SysOpen(char *name)
@@ -0,0 +1,492 @@
+// profile.cc
+//	Routines to profile user programs: count the instructions they
+//	run, follow their calls, sample where they spend their time, and
+//	report on it when they are done.
+//
+//	The symbol table is read from the MIPS ECOFF file the program
+//	was converted from.  Its layout is described in <sym.h> and
+//	<symconst.h> on the systems that produced it; only the parts
+//	needed to find procedures are decoded here.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "main.h"
+#include "profile.h"
+#include "mipsops.h"
+#include "list.h"
+
+// Where things are in an ECOFF file: the file header, the symbolic
+// header it points to, and the records that in turn points to.
+
+const int CoffSymPtr = 8;		// file header: symbolic header offset
+const int SymMagic = 0x7009;		// symbolic header: magic number
+const int SymIssOffset = 60;		//	local strings
+const int SymFdMax = 72;		//	number of file descriptors
+const int SymFdOffset = 76;		//	... and where they are
+const int SymSymOffset = 36;		//	local symbols
+const int SymExtMax = 88;		//	number of external symbols
+const int SymExtOffset = 92;		//	... and where they are
+const int SymSsExtOffset = 68;		//	external strings
+const int SymHeaderSize = 96;
+
+const int FdSize = 72;			// file descriptor: size
+const int FdIssBase = 8;		//	its first local string
+const int FdSymBase = 16;		//	its first local symbol
+const int FdSymCount = 20;		//	... and how many
+const int SymSize = 12;			// local symbol: size; its string,
+					// value and type are at 0, 4, 8
+const int ExtSize = 16;			// external symbol: size; its local
+const int ExtSym = 4;			// symbol is at 4
+
+const int StProc = 6;			// symbol types: a procedure
+const int StStaticProc = 14;		//	a static procedure
+
+// Profiles of the programs running now.
+static List<Profile *> *profiles = NULL;
+
+//----------------------------------------------------------------------
+// CoffWord
+// 	Return the word at "offset" in "buffer" of "size" bytes, or 0 if
+//	it is past the end.
+//----------------------------------------------------------------------
+
+static int
+CoffWord(char *buffer, int size, int offset)
+{
+    unsigned int word;
+
+    if (offset < 0 || offset + 4 > size)
+	return 0;
+    bcopy(&buffer[offset], (char *) &word, 4);
+    return (int) WordToHost(word);
+}
+
+//----------------------------------------------------------------------
+// CoffString
+// 	Return the null-terminated string at "offset" in "buffer" of
+//	"size" bytes, or NULL if it doesn't all fit.
+//----------------------------------------------------------------------
+
+static char *
+CoffString(char *buffer, int size, int offset)
+{
+    if (offset < 0 || offset >= size
+		|| memchr(&buffer[offset], '\0', size - offset) == NULL)
+	return NULL;
+    return &buffer[offset];
+}
+
+//----------------------------------------------------------------------
+// Profile::Profile
+// 	Get ready to profile a run of the program in "fileName", and
+//	read in its symbols.
+//
+//	"interval" -- user ticks between samples of the program counter
+//----------------------------------------------------------------------
+
+Profile::Profile(char *fileName, int interval)
+{
+    ASSERT(interval > 0);
+    this->fileName = new char[strlen(fileName) + 1];
+    strcpy(this->fileName, fileName);
+    this->interval = interval;
+    userTicks = 0;
+    nextSample = interval;
+    numSamples = 0;
+
+    symbols = NULL;
+    numSymbols = maxSymbols = 0;
+    LoadSymbols();
+
+    depth = lost = 0;
+    callee = returnPC = -1;
+    stacks = new ProfileStack[MaxProfileStacks];
+    numStacks = otherStacks = 0;
+    opCounts = new int[MaxOpcode + 1];
+    for (int i = 0; i <= MaxOpcode; i++)
+	opCounts[i] = 0;
+    numLoads = numStores = 0;
+    reported = FALSE;
+
+    if (profiles == NULL)
+	profiles = new List<Profile *>;
+    profiles->Append(this);
+}
+
+//----------------------------------------------------------------------
+// Profile::~Profile
+// 	The program is done: report on it, unless that has been done
+//	already, and de-allocate the profile.
+//----------------------------------------------------------------------
+
+Profile::~Profile()
+{
+    if (!reported)
+	Report();
+    profiles->Remove(this);
+    for (int i = 0; i < numSymbols; i++)
+	delete [] symbols[i].name;
+    delete [] symbols;
+    delete [] stacks;
+    delete [] opCounts;
+    delete [] fileName;
+}
+
+//----------------------------------------------------------------------
+// Profile::AddSymbol
+// 	Add function "name", starting at "address", to the symbols.  The
+//	array doubles when it fills up, so adding them all is linear;
+//	they are put in order afterwards, by SortSymbols.
+//----------------------------------------------------------------------
+
+void
+Profile::AddSymbol(char *name, int address)
+{
+    if (numSymbols == maxSymbols) {
+	ProfileSymbol *old = symbols;
+
+	maxSymbols = (maxSymbols == 0) ? 64 : maxSymbols * 2;
+	symbols = new ProfileSymbol[maxSymbols];
+	for (int i = 0; i < numSymbols; i++)
+	    symbols[i] = old[i];
+	delete [] old;
+    }
+    symbols[numSymbols].name = new char[strlen(name) + 1];
+    strcpy(symbols[numSymbols].name, name);
+    symbols[numSymbols].address = address;
+    symbols[numSymbols].self = symbols[numSymbols].total = 0;
+    numSymbols++;
+}
+
+//----------------------------------------------------------------------
+// CompareSymbols
+// 	Order symbols for qsort: by address.
+//----------------------------------------------------------------------
+
+static int
+CompareSymbols(const void *x, const void *y)
+{
+    int a = ((const ProfileSymbol *) x)->address;
+    int b = ((const ProfileSymbol *) y)->address;
+
+    return (a < b) ? -1 : (a > b) ? 1 : 0;
+}
+
+//----------------------------------------------------------------------
+// Profile::SortSymbols
+// 	Sort the symbols by address, as FindSymbol needs them, once they
+//	have all been added.
+//----------------------------------------------------------------------
+
+void
+Profile::SortSymbols()
+{
+    qsort(symbols, numSymbols, sizeof(ProfileSymbol), CompareSymbols);
+}
+
+//----------------------------------------------------------------------
+// Profile::LoadSymbols
+// 	Find the procedures in the symbol table of "fileName".coff:
+//	every external procedure, and every static one in each source
+//	file.  If there is no symbol table, everything is charged to a
+//	single unnamed function.
+//----------------------------------------------------------------------
+
+void
+Profile::LoadSymbols()
+{
+    char *coffName = new char[strlen(fileName) + 6];
+    char *buffer = NULL;
+    int fd, size = 0, hdr;
+
+    sprintf(coffName, "%s.coff", fileName);
+    fd = OpenForReadWrite(coffName, FALSE);
+    if (fd >= 0) {
+	Lseek(fd, 0, SEEK_END);
+	size = Tell(fd);
+	Lseek(fd, 0, SEEK_SET);
+	buffer = new char[size];
+	Read(fd, buffer, size);
+	Close(fd);
+    }
+
+    hdr = CoffWord(buffer, size, CoffSymPtr);
+    if (buffer == NULL || hdr <= 0 || hdr + SymHeaderSize > size
+		|| (CoffWord(buffer, size, hdr) & 0xffff) != SymMagic) {
+	cerr << "No symbols for " << fileName << " in " << coffName << "\n";
+	AddSymbol("?", 0);
+	delete [] buffer;
+	delete [] coffName;
+	return;
+    }
+
+    int extOffset = CoffWord(buffer, size, hdr + SymExtOffset);
+    int extStrings = CoffWord(buffer, size, hdr + SymSsExtOffset);
+    for (int i = 0; i < CoffWord(buffer, size, hdr + SymExtMax); i++) {
+	int sym = extOffset + i * ExtSize + ExtSym;
+	char *name = CoffString(buffer, size,
+				extStrings + CoffWord(buffer, size, sym));
+
+	if ((CoffWord(buffer, size, sym + 8) & 0x3f) == StProc && name != NULL)
+	    AddSymbol(name, CoffWord(buffer, size, sym + 4));
+    }
+
+    int fdOffset = CoffWord(buffer, size, hdr + SymFdOffset);
+    int symOffset = CoffWord(buffer, size, hdr + SymSymOffset);
+    int strings = CoffWord(buffer, size, hdr + SymIssOffset);
+    for (int f = 0; f < CoffWord(buffer, size, hdr + SymFdMax); f++) {
+	int fdr = fdOffset + f * FdSize;
+	int first = CoffWord(buffer, size, fdr + FdSymBase);
+	int issBase = CoffWord(buffer, size, fdr + FdIssBase);
+
+	for (int i = 0; i < CoffWord(buffer, size, fdr + FdSymCount); i++) {
+	    int sym = symOffset + (first + i) * SymSize;
+	    char *name = CoffString(buffer, size,
+			strings + issBase + CoffWord(buffer, size, sym));
+
+	    if ((CoffWord(buffer, size, sym + 8) & 0x3f) == StStaticProc
+			&& name != NULL)
+		AddSymbol(name, CoffWord(buffer, size, sym + 4));
+	}
+    }
+    SortSymbols();
+    if (numSymbols == 0 || symbols[0].address > 0) {
+	AddSymbol("?", 0);		// so every pc is in something
+	SortSymbols();
+    }
+    DEBUG(dbgAddr, "Read " << numSymbols << " symbols from " << coffName);
+    delete [] buffer;
+    delete [] coffName;
+}
+
+//----------------------------------------------------------------------
+// Profile::FindSymbol
+// 	Return the index of the function holding "pc": the last one that
+//	starts at or before it.
+//----------------------------------------------------------------------
+
+int
+Profile::FindSymbol(int pc)
+{
+    int low = 0, high = numSymbols - 1;
+
+    while (low < high) {
+	int middle = (low + high + 1) / 2;
+
+	if (symbols[middle].address <= pc)
+	    low = middle;
+	else
+	    high = middle - 1;
+    }
+    return low;
+}
+
+//----------------------------------------------------------------------
+// Profile::Step
+// 	Called by the simulator for each instruction the program runs.
+//	Count it, follow it if it is a call or return, and take a sample
+//	if one is due, by the user time this program has run.
+//
+//	"instr" -- the instruction
+//	"pc" -- where it is
+//	"nextPC" -- where the instruction after its delay slot, if it has
+//		one, comes from
+//----------------------------------------------------------------------
+
+void
+Profile::Step(Instruction *instr, int pc, int nextPC)
+{
+    opCounts[(unsigned char) instr->opCode]++;
+    switch (instr->opCode) {
+      case OP_LB: case OP_LBU: case OP_LH: case OP_LHU:
+      case OP_LW: case OP_LWL: case OP_LWR:
+	numLoads++;
+	break;
+
+      case OP_SB: case OP_SH: case OP_SW: case OP_SWL: case OP_SWR:
+	numStores++;
+	break;
+    }
+
+    // Sample on this program's own time; other programs' doesn't count.
+    userTicks += UserTick;
+    if (userTicks >= nextSample) {
+	Sample(pc);
+	nextSample += interval;
+    }
+
+    // A call or return only takes effect once the instruction in its
+    // delay slot -- this one, if one is pending -- has been run and
+    // charged to the function it is in.
+    if (callee != -1) {
+	if (depth < MaxProfileDepth) {
+	    stack[depth] = callee;
+	    returnTo[depth] = pc + 4;	// the delay slot was at pc
+	    depth++;
+	} else {
+	    lost++;
+	}
+	callee = -1;
+    } else if (returnPC != -1) {	// unwind to the caller
+	for (int i = depth - 1; i >= 0; i--) {
+	    if (returnTo[i] == returnPC) {
+		depth = i;
+		break;
+	    }
+	}
+	returnPC = -1;
+    }
+
+    switch (instr->opCode) {
+      case OP_BGEZAL: case OP_BLTZAL:
+	if (nextPC == pc + 8)		// not taken
+	    break;
+      case OP_JAL: case OP_JALR:
+	callee = FindSymbol(nextPC);
+	break;
+
+      case OP_JR:
+	if (instr->rs == RetAddrReg)
+	    returnPC = nextPC;
+	break;
+    }
+}
+
+//----------------------------------------------------------------------
+// Profile::Sample
+// 	Charge a sample to the function holding "pc" and to the functions
+//	on the call stack leading to it, and count the call stack.
+//----------------------------------------------------------------------
+
+void
+Profile::Sample(int pc)
+{
+    int frames[MaxProfileDepth + 2];
+    int n = 0;
+    int leaf = FindSymbol(pc);
+    int i, j;
+
+    frames[n++] = FindSymbol(0);	// where the program started
+    for (i = 0; i < depth; i++)
+	frames[n++] = stack[i];
+    if (frames[n - 1] != leaf)		// e.g. jumped to, not called
+	frames[n++] = leaf;
+
+    numSamples++;
+    symbols[leaf].self++;
+    for (i = 0; i < n; i++) {		// once each, even if recursive
+	for (j = 0; j < i && frames[j] != frames[i]; j++)
+	    ;
+	if (j == i)
+	    symbols[frames[i]].total++;
+    }
+
+    if (n > MaxProfileDepth + 1) {	// keep a stack's innermost frames
+	frames[MaxProfileDepth] = frames[n - 1];
+	n = MaxProfileDepth + 1;
+    }
+    for (i = 0; i < numStacks; i++) {
+	if (stacks[i].depth == n && bcmp((char *) stacks[i].frames,
+				(char *) frames, n * sizeof(int)) == 0) {
+	    stacks[i].count++;
+	    return;
+	}
+    }
+    if (numStacks == MaxProfileStacks) {
+	otherStacks++;
+	return;
+    }
+    stacks[numStacks].depth = n;
+    bcopy((char *) frames, (char *) stacks[numStacks].frames, n * sizeof(int));
+    stacks[numStacks].count = 1;
+    numStacks++;
+}
+
+//----------------------------------------------------------------------
+// Profile::Report
+// 	Print the time spent in each function, itself and all told, and
+//	the mix of instructions run; and write the sampled call stacks
+//	to "fileName".folded, for a flame graph.
+//----------------------------------------------------------------------
+
+void
+Profile::Report()
+{
+    char *foldedName = new char[strlen(fileName) + 8];
+    char line[200];
+    int i, j, fd;
+
+    reported = TRUE;
+    cout << "Profile of " << fileName << ": " << numSamples
+	 << " samples, one every " << interval << " user ticks\n";
+    cout << "     self    total  function\n";
+    for (;;) {				// most time spent in itself first
+	int best = -1;
+
+	for (i = 0; i < numSymbols; i++) {
+	    if (symbols[i].total > 0 && (best == -1 ||
+			symbols[i].self > symbols[best].self))
+		best = i;
+	}
+	if (best == -1)
+	    break;
+	snprintf(line, sizeof(line), "%9d %8d  %s",
+			symbols[best].self * interval,
+			symbols[best].total * interval, symbols[best].name);
+	cout << line << "\n";
+	symbols[best].total = -symbols[best].total;	// printed
+    }
+    for (i = 0; i < numSymbols; i++)
+	symbols[i].total = -symbols[i].total;
+
+    cout << "Instructions:";
+    for (i = 0, j = 0; i <= MaxOpcode; i++) {
+	if (opCounts[i] > 0) {
+	    char *name = opStrings[i].format;
+
+	    cout << ((j++ % 6 == 0) ? "\n   " : ",") << " ";
+	    cout.write(name, strcspn(name, " ")) << " " << opCounts[i];
+	}
+    }
+    cout << "\nMemory: loads " << numLoads << ", stores " << numStores << "\n";
+    if (lost > 0 || otherStacks > 0)
+	cout << "Calls too deep to follow " << lost
+	     << ", samples of stacks not kept " << otherStacks << "\n";
+
+    sprintf(foldedName, "%s.folded", fileName);
+    fd = OpenForWrite(foldedName);
+    for (i = 0; i < numStacks; i++) {
+	for (j = 0; j < stacks[i].depth; j++) {
+	    char *name = symbols[stacks[i].frames[j]].name;
+
+	    if (j > 0)
+		WriteFile(fd, ";", 1);
+	    WriteFile(fd, name, strlen(name));
+	}
+	sprintf(line, " %d\n", stacks[i].count * interval);
+	WriteFile(fd, line, strlen(line));
+    }
+    Close(fd);
+    delete [] foldedName;
+}
+
+//----------------------------------------------------------------------
+// Profile::ReportAll
+// 	Nachos is halting, so the programs still running won't get to
+//	report on themselves; report on them now.
+//----------------------------------------------------------------------
+
+void
+Profile::ReportAll()
+{
+    if (profiles == NULL)
+	return;
+    ListIterator<Profile *> iter(profiles);
+    for (; !iter.IsDone(); iter.Next()) {
+	if (!iter.Item()->reported)
+	    iter.Item()->Report();
+    }
+}
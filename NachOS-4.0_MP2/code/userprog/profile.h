@@ -0,0 +1,103 @@
+// profile.h
+//	Data structures for profiling user programs.
+//
+//	A Profile watches one address space run.  Every instruction is
+//	counted by opcode, along with the loads and stores among them,
+//	and calls and returns are followed to keep a shadow copy of the
+//	program's call stack.  Every so many ticks of user time, the
+//	program counter is sampled and charged, with the call stack
+//	leading to it, to the functions it is in.
+//
+//	Program counters are resolved to function names with the symbol
+//	table in the COFF file the program was made from ("foo.coff"
+//	for "foo").  The call stacks are written out in the "collapsed"
+//	format flame graph tools take ("foo.folded"), one stack per
+//	line, with the number of ticks spent in it.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "machine.h"
+
+const int MaxProfileDepth = 64;		// deepest call stack kept
+const int MaxProfileStacks = 1024;	// distinct call stacks kept
+
+// A function of the program being profiled.
+
+class ProfileSymbol {
+  public:
+    char *name;
+    int address;		// where it starts
+    int self;			// samples in the function itself
+    int total;			// samples in it or in what it calls
+};
+
+// A call stack seen when sampling, as indices into the symbols.
+
+class ProfileStack {
+  public:
+    int depth;
+    int frames[MaxProfileDepth + 1];
+    int count;			// times it was sampled
+};
+
+class Profile {
+  public:
+    Profile(char *fileName, int interval);
+				// Profile a run of program "fileName",
+				// sampling every "interval" user ticks
+    ~Profile();			// Report on the run, and de-allocate
+
+    void Step(Instruction *instr, int pc, int nextPC);
+				// An instruction at "pc" has been run
+				// successfully; "nextPC" is where the one
+				// after its delay slot will come from
+
+    static void ReportAll();	// Report on runs still going, because
+				// Nachos is about to halt
+
+  private:
+    char *fileName;		// the program
+    int interval;		// user ticks between samples
+    int userTicks;		// user time the program has run
+    int nextSample;		// ... when the next sample is due
+    int numSamples;
+
+    ProfileSymbol *symbols;	// the program's functions, by address
+    int numSymbols;
+    int maxSymbols;		// room in "symbols"
+
+    int stack[MaxProfileDepth];	// functions called, outermost first
+    int returnTo[MaxProfileDepth];	// ... and where each returns to
+    int depth;			// number of calls in "stack"
+    int lost;			// calls nested too deep to keep
+    int callee;			// function being called, once the delay
+				// slot has run; -1 if none
+    int returnPC;		// where a return is going, likewise
+
+    ProfileStack *stacks;	// call stacks sampled
+    int numStacks;
+    int otherStacks;		// samples of stacks there was no room for
+
+    int *opCounts;		// instructions run, by opcode
+    int numLoads;		// loads from memory
+    int numStores;		// stores to memory
+
+    bool reported;		// has Report been called?
+
+    void LoadSymbols();		// Read the COFF symbol table
+    void AddSymbol(char *name, int address);
+				// Add a function, in any order
+    void SortSymbols();		// Put them in order, once all added
+    int FindSymbol(int pc);	// The function holding "pc"
+    void Sample(int pc);	// Charge the sampled pc to its functions
+    void Report();		// Print the profile, and save the stacks
+};
+
+#endif // PROFILE_H
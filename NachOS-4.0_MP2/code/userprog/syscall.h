@@ -35,6 +35,8 @@
 #define SC_ThreadExit   14
 #define SC_ThreadJoin   15
 #define SC_PrintInt     16
+#define SC_Fork		17
+#define SC_Sleep	18
 #define SC_Add		42
 #define SC_MSG		100
 #ifndef IN_ASM
@@ -90,6 +92,18 @@ SpaceId ExecV(int argc, char* argv[]);
  * Return the exit status.
  */
 int Join(SpaceId id); 	
+
+/* Start a copy of this user program, running on from the same place.
+ * Its memory is shared with this one until either of them writes to it.
+ * Return the copy's SpaceId to this program, and 0 to the copy;
+ * negative error code on failure.
+ */
+SpaceId Fork();
+
+/* Give up the CPU for "ticks" ticks of simulated time.  Other programs
+ * run meanwhile; if there are none, the machine idles until then.
+ */
+void Sleep(int ticks);
  
 
 /* File system operations: Create, Remove, Open, Read, Write, Close